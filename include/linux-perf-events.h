@@ -19,46 +19,63 @@ template<int TYPE = PERF_TYPE_HARDWARE>
 class LinuxEvents {
     int fd;
     bool working;
+    bool exclude_kernel;
+    int pid;
+    int cpu;
+    int error;
+    bool open_failed;
     perf_event_attr attribs;
     int num_events;
+    std::vector<int> configs;
+    std::vector<int> fds;
     std::vector<uint64_t> temp_result_vec;
     std::vector<uint64_t> ids;
+    uint64_t total_enabled;
+    uint64_t total_running;
+    uint64_t enabled;
+    uint64_t running;
 
 public:
-    explicit LinuxEvents(std::vector<int> config_vec) : fd(0), working(true) {
-        memset(&attribs, 0, sizeof(attribs));
-        attribs.type = TYPE;
-        attribs.size = sizeof(attribs);
-        attribs.disabled = 1;
-        attribs.exclude_kernel = 1;
-        attribs.exclude_hv = 1;
+    /// Kernel events, e.g. tracepoints, need exclude_kernel = false, which perf_event_paranoid may not permit.
+    /// pid = 0, cpu = -1 counts the calling thread on any CPU, pid = -1, cpu = N all processes on CPU N.
+    explicit LinuxEvents(std::vector<int> config_vec, bool exclude_kernel = true, int pid = 0, int cpu = -1)
+            : fd(-1), working(true), exclude_kernel(exclude_kernel), pid(pid), cpu(cpu), error(0),
+              open_failed(false), configs(std::move(config_vec)), total_enabled(0), total_running(0), enabled(0), running(0) {
+        open_events();
+    }
 
-        attribs.sample_period = 0;
-        attribs.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
-        const int pid = 0;  // the current process
-        const int cpu = -1; // all CPUs
-        const unsigned long flags = 0;
+    ~LinuxEvents() { close_events(); }
 
-        int group = -1; // no group
-        num_events = config_vec.size();
-        ids.resize(config_vec.size());
-        uint32_t i = 0;
-        for (auto config: config_vec) {
-            attribs.config = config;
-            fd = syscall(__NR_perf_event_open, &attribs, pid, cpu, group, flags);
-            if (fd == -1) {
-                report_error("perf_event_open");
-            }
-            ioctl(fd, PERF_EVENT_IOC_ID, &ids[i++]);
-            if (group == -1) {
-                group = fd;
-            }
+    /// Open the counters again for the calling thread. The counters only follow the thread
+    /// that opened them, so this is needed e.g. in a forked child process. If perf_event_open
+    /// failed before, it fails again, so the error is kept and nothing is opened.
+    void reopen() {
+        if (open_failed) {
+            return;
         }
-
-        temp_result_vec.resize(num_events * 2 + 1);
+        close_events();
+        working = true;
+        error = 0;
+        open_events();
     }
 
-    ~LinuxEvents() { close(fd); }
+    /// False once an error was reported, the results are meaningless then.
+    bool is_working() const { return working; }
+
+    /// errno of the first reported error, 0 if none.
+    int get_error() const { return error; }
+
+    /// Time in ns the counters were enabled and actually counting between the previous read and the last one.
+    /// Running less than enabled means the kernel multiplexed the counters, e.g. because there are more events
+    /// than hardware counters, and the counts only cover part of the interval.
+    uint64_t get_time_enabled() const { return enabled; }
+
+    uint64_t get_time_running() const { return running; }
+
+    bool is_multiplexed() const { return running < enabled; }
+
+    /// Bytes returned by each read() of the counters.
+    size_t get_read_size() const { return temp_result_vec.size() * sizeof(uint64_t); }
 
     inline void start() {
         if (ioctl(fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1) {
@@ -75,20 +92,77 @@ public:
             report_error("ioctl(PERF_EVENT_IOC_DISABLE)");
         }
 
-        if (read(fd, temp_result_vec.data(), temp_result_vec.size() * 8) == -1) {
+        read_counters(results);
+    }
+
+    /// Read the counters without stopping them.
+    inline void read_counters(std::vector<unsigned long long> &results) {
+        if (::read(fd, temp_result_vec.data(), temp_result_vec.size() * 8) == -1) {
             report_error("read");
+            return;
         }
-        // our actual results are in slots 1,3,5, ... of this structure
+        // slots 1 and 2 are the time enabled and running since the counters were opened,
+        // our actual results are in slots 3,5,7, ... of this structure
         // we really should be checking our ids obtained earlier to be safe
-        for (uint32_t i = 1; i < temp_result_vec.size(); i += 2) {
-            results[i / 2] = temp_result_vec[i];
+        enabled = temp_result_vec[1] - total_enabled;
+        running = temp_result_vec[2] - total_running;
+        total_enabled = temp_result_vec[1];
+        total_running = temp_result_vec[2];
+        for (uint32_t i = 3; i < temp_result_vec.size(); i += 2) {
+            results[i / 2 - 1] = temp_result_vec[i];
         }
     }
 
 private:
+    void open_events() {
+        memset(&attribs, 0, sizeof(attribs));
+        attribs.type = TYPE;
+        attribs.size = sizeof(attribs);
+        attribs.disabled = 1;
+        attribs.exclude_kernel = exclude_kernel;
+        attribs.exclude_hv = 1;
+
+        attribs.sample_period = 0;
+        attribs.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                              PERF_FORMAT_TOTAL_TIME_RUNNING;
+        const unsigned long flags = 0;
+
+        int group = -1; // no group
+        num_events = configs.size();
+        ids.resize(configs.size());
+        uint32_t i = 0;
+        for (auto config: configs) {
+            attribs.config = config;
+            fd = syscall(__NR_perf_event_open, &attribs, pid, cpu, group, flags);
+            if (fd == -1) {
+                open_failed = true;
+                report_error("perf_event_open");
+            } else {
+                fds.push_back(fd);
+            }
+            ioctl(fd, PERF_EVENT_IOC_ID, &ids[i++]);
+            if (group == -1) {
+                group = fd;
+            }
+        }
+
+        temp_result_vec.resize(num_events * 2 + 3);
+    }
+
+    void close_events() {
+        for (auto event_fd: fds) {
+            close(event_fd);
+        }
+        fds.clear();
+        fd = -1;
+        total_enabled = total_running = enabled = running = 0;
+    }
+
     void report_error(const std::string &context) {
-        if (working)
+        if (working) {
+            error = errno;
             std::cerr << (context + ": " + std::string(strerror(errno))) << std::endl;
+        }
         working = false;
     }
 };
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "utilities.hpp"
+
+namespace mperf {
+    enum CacheMode {
+        MINI_CACHE_WARM = 0,        // Keep whatever the previous iteration left in the caches.
+        MINI_CACHE_COLD = 1,        // Flush declared buffers, or evict the LLC, before each iteration.
+        MINI_CACHE_TLB_COLD = 2,    // Touch a large region before each iteration to evict TLB entries.
+    };
+
+    inline std::string get_cache_mode_name(int mode) {
+        if (mode == MINI_CACHE_WARM) {
+            return "Warm";
+        } else if (mode == MINI_CACHE_COLD) {
+            return "Cold";
+        } else if (mode == MINI_CACHE_TLB_COLD) {
+            return "TLB Cold";
+        } else {
+            return "Unknown";
+        }
+    }
+
+    /// Puts the caches into the state requested by the cache mode before a benchmark iteration.
+    /// prepare() must be called outside of MiniPerf::start() and MiniPerf::stop() so that the
+    /// flushing is excluded from timing and counters.
+    class CacheControl {
+        CacheMode mode;
+        std::vector<std::pair<const volatile char *, size_t>> buffers;
+        std::vector<char> evict_buffer;
+        char *tlb_buffer = nullptr;
+        size_t tlb_buffer_size = 0;
+        size_t line_size;
+        size_t page_size;
+        volatile char sink = 0;
+
+        public:
+        // Number of distinct pages touched in TLB cold mode, larger than the STLB of current cores.
+        static constexpr size_t tlb_evict_pages = 16384;
+
+        explicit CacheControl(CacheMode mode = MINI_CACHE_WARM) : mode(mode) {
+            long line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+            line_size = line > 0 ? line : 64;
+            page_size = sysconf(_SC_PAGE_SIZE);
+        }
+
+        CacheControl(const CacheControl &) = delete;
+        CacheControl &operator=(const CacheControl &) = delete;
+
+        ~CacheControl() {
+            if (tlb_buffer) {
+                munmap(tlb_buffer, tlb_buffer_size);
+            }
+        }
+
+        void set_mode(CacheMode new_mode) {
+            mode = new_mode;
+        }
+
+        CacheMode get_mode() const {
+            return mode;
+        }
+
+        /// Declare an input buffer to be flushed in cold mode. Without declared buffers the
+        /// whole last level cache is evicted instead.
+        void add_buffer(const volatile void *ptr, size_t bytes) {
+            buffers.emplace_back(static_cast<const volatile char *>(ptr), bytes);
+        }
+
+        void clear_buffers() {
+            buffers.clear();
+        }
+
+        void prepare() {
+            if (mode == MINI_CACHE_COLD) {
+                if (buffers.empty()) {
+                    evict_llc();
+                } else {
+                    flush_buffers();
+                }
+            } else if (mode == MINI_CACHE_TLB_COLD) {
+                evict_tlb();
+            }
+        }
+
+        private:
+        void flush_buffers() {
+#if defined(__x86_64__) || defined(__i386__)
+            for (auto &[ptr, bytes]: buffers) {
+                auto begin = reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t(line_size) - 1);
+                auto end = reinterpret_cast<uintptr_t>(ptr) + bytes;
+                for (auto line = begin; line < end; line += line_size) {
+                    _mm_clflush(reinterpret_cast<const void *>(line));
+                }
+            }
+            _mm_mfence();
+#else
+            evict_llc();
+#endif
+        }
+
+        /// The sweeps only read, so that no dirty lines are left whose writebacks would be charged to the
+        /// timed iteration.
+        void evict_llc() {
+            if (evict_buffer.empty()) {
+                // Twice the LLC so that adaptive replacement policies cannot keep the old lines.
+                size_t llc = get_cache_size();
+                evict_buffer.resize(2 * (llc ? llc : 64 * 1024 * 1024));
+            }
+            const volatile char *data = evict_buffer.data();
+            char sum = 0;
+            for (size_t i = 0; i < evict_buffer.size(); i += line_size) {
+                sum += data[i];
+            }
+            sink = sum;
+        }
+
+        void evict_tlb() {
+            if (!tlb_buffer) {
+                // Backed by small pages, a THP backed buffer would need only a few TLB entries.
+                tlb_buffer_size = tlb_evict_pages * page_size;
+                void *buffer = mmap(nullptr, tlb_buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                                    -1, 0);
+                if (buffer == MAP_FAILED) {
+                    throw std::runtime_error("Failed to map the TLB eviction buffer.");
+                }
+                madvise(buffer, tlb_buffer_size, MADV_NOHUGEPAGE);
+                tlb_buffer = static_cast<char *>(buffer);
+                // Fault in private pages, reads alone would all map the shared zero page.
+                for (size_t i = 0; i < tlb_buffer_size; i += page_size) {
+                    tlb_buffer[i] = 1;
+                }
+            }
+            const volatile char *data = tlb_buffer;
+            char sum = 0;
+            for (size_t i = 0; i < tlb_buffer_size; i += page_size) {
+                sum += data[i];
+            }
+            sink = sum;
+        }
+    };
+}   // namespace mperf
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <coroutine>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+
+namespace mperf {
+    /// Measures a region inside a coroutine with a MiniPerf instance, excluding the time the
+    /// coroutine is suspended. Around each suspension the instance is stopped and started again,
+    /// so time and counters of other tasks running on the thread meanwhile are not counted. If the
+    /// coroutine resumes on another thread, the counters are reopened for that thread. Metrics that
+    /// describe a single interval (MINI_MEMORY_TOTAL, rates, MINI_CPU_UTILIZATION) are those of the
+    /// last resumed part.
+    template<typename Perf>
+    class CoroutinePerf {
+        Perf &perf;
+        ClockTimePointType suspend_time;
+        ClockDurationType suspended_time{};
+        size_t resumptions{};
+        bool running{};
+
+        /// Reopen the counters if they count another thread than the calling one.
+        void follow_thread() {
+            if (perf.get_counter_thread() != std::this_thread::get_id()) {
+                perf.reopen_counters();
+            }
+        }
+
+        public:
+        explicit CoroutinePerf(Perf &perf) : perf(perf) {}
+
+        CoroutinePerf(const CoroutinePerf &) = delete;
+
+        void start() {
+            follow_thread();
+            running = true;
+            perf.start();
+        }
+
+        /// Stop the region and add the suspended time and the resumptions as custom metrics.
+        void stop() {
+            using TimeDurationType = decltype(perf.get_time_count());
+            perf.stop();
+            running = false;
+            auto suspended = std::chrono::duration_cast<TimeDurationType>(suspended_time).count();
+            perf.add_custom_metric("Suspended Time(" + get_time_unit<TimeDurationType>() + ")",
+                                   std::to_string(suspended));
+            perf.add_custom_metric("Resumptions", std::to_string(resumptions));
+        }
+
+        void reset() {
+            perf.reset();
+            suspended_time = ClockDurationType::zero();
+            resumptions = 0;
+        }
+
+        /// Called right before the coroutine suspends.
+        void on_suspend() {
+            if (running) {
+                perf.stop();
+                suspend_time = ClockType::now();
+            }
+        }
+
+        /// Called when the coroutine resumes, possibly on another thread. suspended is false if
+        /// the awaiter decided not to suspend after on_suspend().
+        void on_resume(bool suspended = true) {
+            if (running) {
+                if (suspended) {
+                    suspended_time += ClockType::now() - suspend_time;
+                    resumptions += 1;
+                }
+                follow_thread();
+                perf.start();
+            }
+        }
+
+        ClockDurationType get_suspended_time() const {
+            return suspended_time;
+        }
+
+        size_t get_resumptions() const {
+            return resumptions;
+        }
+
+        /// Wrap an awaitable so that its suspension is excluded: co_await timer.wrap(awaitable).
+        template<typename Awaitable>
+        auto wrap(Awaitable &&awaitable);
+    };
+
+    namespace coroutine_detail {
+        template<typename T>
+        decltype(auto) get_awaiter(T &&value) {
+            if constexpr (requires { std::forward<T>(value).operator co_await(); }) {
+                return std::forward<T>(value).operator co_await();
+            } else if constexpr (requires { operator co_await(std::forward<T>(value)); }) {
+                return operator co_await(std::forward<T>(value));
+            } else {
+                return std::forward<T>(value);
+            }
+        }
+
+        template<typename T>
+        using awaiter_t = decltype(get_awaiter(std::declval<T>()));
+
+        // Lvalue awaiters are referenced, temporaries are moved into the wrapper.
+        template<typename T>
+        using stored_awaiter_t = std::conditional_t<std::is_lvalue_reference_v<awaiter_t<T>>,
+                awaiter_t<T>, std::remove_cvref_t<awaiter_t<T>>>;
+    }   // namespace coroutine_detail
+
+    /// Awaiter that notifies a CoroutinePerf around the suspension of the wrapped awaiter.
+    /// A null timer makes it transparent.
+    template<typename Awaiter, typename Timer>
+    class MeasuredAwaiter {
+        Awaiter awaiter;
+        Timer *timer;
+        bool suspended{};
+
+        public:
+        template<typename Awaitable>
+        MeasuredAwaiter(Awaitable &&awaitable, Timer *timer)
+                : awaiter(coroutine_detail::get_awaiter(std::forward<Awaitable>(awaitable))), timer(timer) {}
+
+        bool await_ready() {
+            return awaiter.await_ready();
+        }
+
+        // The coroutine may be resumed on another thread before the wrapped await_suspend
+        // returns, so nothing of this awaiter is touched after it has suspended.
+        template<typename Promise>
+        auto await_suspend(std::coroutine_handle<Promise> handle) {
+            using Result = decltype(awaiter.await_suspend(handle));
+            suspended = true;
+            if (timer != nullptr) {
+                timer->on_suspend();
+            }
+            if constexpr (std::is_same_v<Result, bool>) {
+                auto *this_timer = timer;
+                if (!awaiter.await_suspend(handle)) {
+                    // Not suspended after all, resume the measurement right away.
+                    suspended = false;
+                    if (this_timer != nullptr) {
+                        this_timer->on_resume(false);
+                    }
+                    return false;
+                }
+                return true;
+            } else {
+                return awaiter.await_suspend(handle);
+            }
+        }
+
+        decltype(auto) await_resume() {
+            if (suspended && timer != nullptr) {
+                timer->on_resume();
+            }
+            return awaiter.await_resume();
+        }
+    };
+
+    template<typename Perf>
+    template<typename Awaitable>
+    auto CoroutinePerf<Perf>::wrap(Awaitable &&awaitable) {
+        return MeasuredAwaiter<coroutine_detail::stored_awaiter_t<Awaitable>, CoroutinePerf<Perf>>(
+                std::forward<Awaitable>(awaitable), this);
+    }
+
+    /// Promise mixin that wraps every co_await of the coroutine. A coroutine whose first parameter
+    /// is a CoroutinePerf is measured by it, e.g.
+    ///     struct promise_type : mperf::MeasuredPromise<mperf::MiniPerf<>> {
+    ///         using MeasuredPromise::MeasuredPromise;
+    ///         ...
+    ///     };
+    ///     Task handle(mperf::CoroutinePerf<mperf::MiniPerf<>> &timer, ...);
+    template<typename Perf>
+    struct MeasuredPromise {
+        CoroutinePerf<Perf> *measured{};
+
+        MeasuredPromise() = default;
+
+        template<typename... Args>
+        explicit MeasuredPromise(CoroutinePerf<Perf> &timer, Args &...) : measured(&timer) {}
+
+        template<typename Awaitable>
+        auto await_transform(Awaitable &&awaitable) {
+            return MeasuredAwaiter<coroutine_detail::stored_awaiter_t<Awaitable>, CoroutinePerf<Perf>>(
+                    std::forward<Awaitable>(awaitable), measured);
+        }
+    };
+}   // namespace mperf
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+
+#include "utilities.hpp"
+
+namespace mperf {
+    namespace energy_detail {
+        inline std::string &powercap_root() {
+            static std::string root = std::getenv("MINI_PERF_POWERCAP_ROOT") != nullptr ?
+                                      std::getenv("MINI_PERF_POWERCAP_ROOT") : "/sys/class/powercap";
+            return root;
+        }
+
+        inline std::string read_line(const std::filesystem::path &path) {
+            std::ifstream file(path, std::ios_base::in);
+            std::string line;
+            std::getline(file, line);
+            return line;
+        }
+
+        /// Parse a sysfs number such as energy_uj, false if the text is empty or not just a number.
+        inline bool parse_counter(std::string_view text, unsigned long long &value) {
+            while (!text.empty() && (text.back() == '\n' || text.back() == ' ')) {
+                text.remove_suffix(1);
+            }
+            auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return error == std::errc() && end == text.data() + text.size();
+        }
+    }   // namespace energy_detail
+
+    /// Set the powercap sysfs directory, "/sys/class/powercap" by default or the value of the
+    /// MINI_PERF_POWERCAP_ROOT environment variable. Affects instances constructed afterwards.
+    inline void set_powercap_root(const std::string &root) {
+        energy_detail::powercap_root() = root;
+    }
+
+    inline const std::string &get_powercap_root() {
+        return energy_detail::powercap_root();
+    }
+
+    /// Get the name of the average power that goes with an energy metric.
+    inline std::string get_power_metric_name(int metric) {
+        if (metric == MINI_ENERGY_PACKAGE) {
+            return "Package Power";
+        } else if (metric == MINI_ENERGY_DRAM) {
+            return "DRAM Power";
+        } else {
+            return "Unknown";
+        }
+    }
+
+    /// A RAPL energy counter, e.g. intel-rapl:0 ("package-0") or intel-rapl:0:2 ("dram").
+    struct RaplDomain {
+        std::string name;
+        std::string path;
+        unsigned long long max_energy_range_uj;
+    };
+
+    /// Find the package domains (names starting with "package"), or the DRAM subdomains of the
+    /// packages (named "dram"), under the powercap root. Empty if the machine has no RAPL.
+    /// max_energy_range_uj is 0 if it cannot be parsed, wraparound is not handled then.
+    inline std::vector<RaplDomain> find_rapl_domains(bool dram) {
+        std::vector<RaplDomain> domains;
+        std::error_code error;
+        for (auto &entry: std::filesystem::directory_iterator(get_powercap_root(), error)) {
+            auto dir_name = entry.path().filename().string();
+            if (dir_name.rfind("intel-rapl:", 0) != 0) {
+                continue;
+            }
+            // intel-rapl:N is a package, intel-rapl:N:M one of its subdomains.
+            bool subdomain = dir_name.find(':') != dir_name.rfind(':');
+            auto name = energy_detail::read_line(entry.path() / "name");
+            if (dram ? (subdomain && name == "dram") : (!subdomain && name.rfind("package", 0) == 0)) {
+                unsigned long long range = 0;
+                if (!energy_detail::parse_counter(energy_detail::read_line(entry.path() / "max_energy_range_uj"),
+                                                  range)) {
+                    range = 0;
+                }
+                domains.push_back({name, (entry.path() / "energy_uj").string(), range});
+            }
+        }
+        std::sort(domains.begin(), domains.end(), [](const RaplDomain &a, const RaplDomain &b) {
+            return a.path < b.path;
+        });
+        return domains;
+    }
+
+    /// Measures the energy in uJ of all package or all DRAM domains between start() and stop().
+    /// The energy_uj files are kept open between samples. Counter wraparound is handled with
+    /// max_energy_range_uj, which is enough as long as an interval is shorter than one wrap
+    /// (minutes at full load). A domain whose energy_uj cannot be parsed is unavailable from then
+    /// on and counts 0.
+    class EnergyReader {
+        std::vector<RaplDomain> domains;
+        std::vector<std::unique_ptr<ProcFileReader>> readers;
+        std::vector<unsigned long long> start_values;
+        std::vector<char> available;    // Per domain.
+
+        bool read_domain(size_t i, unsigned long long &value) {
+            if (!available[i]) {
+                return false;
+            }
+            if (!energy_detail::parse_counter(readers[i]->read(), value)) {
+                std::cerr << "Cannot parse " << domains[i].path << ", its energy is 0 from now on." << std::endl;
+                available[i] = false;
+                return false;
+            }
+            return true;
+        }
+
+        public:
+        explicit EnergyReader(bool dram) : domains(find_rapl_domains(dram)) {
+            if (domains.empty()) {
+                std::cerr << "No RAPL " << (dram ? "DRAM" : "package") << " domains in " << get_powercap_root()
+                          << ", energy metrics are 0." << std::endl;
+                return;
+            }
+            for (auto &domain: domains) {
+                readers.push_back(std::make_unique<ProcFileReader>(domain.path));
+            }
+            start_values.resize(domains.size());
+            available.resize(domains.size(), true);
+            // energy_uj is readable by root only on most recent kernels.
+            for (size_t i = 0; i < readers.size(); ++i) {
+                unsigned long long value;
+                if (readers[i]->read().empty()) {
+                    std::cerr << "Cannot read " << domains[i].path << ", energy metrics are 0." << std::endl;
+                    readers.clear();
+                    break;
+                }
+                read_domain(i, value);
+            }
+        }
+
+        EnergyReader(const EnergyReader &) = delete;
+
+        bool is_available() const {
+            return !readers.empty() && std::find(available.begin(), available.end(), true) != available.end();
+        }
+
+        const std::vector<RaplDomain> &get_domains() const {
+            return domains;
+        }
+
+        void start() {
+            for (size_t i = 0; i < readers.size(); ++i) {
+                read_domain(i, start_values[i]);
+            }
+        }
+
+        /// Energy in uJ since start(), summed over the domains.
+        unsigned long long stop() {
+            unsigned long long energy = 0;
+            for (size_t i = 0; i < readers.size(); ++i) {
+                unsigned long long value;
+                if (!read_domain(i, value)) {
+                    continue;
+                }
+                if (value >= start_values[i]) {
+                    energy += value - start_values[i];
+                } else if (domains[i].max_energy_range_uj >= start_values[i]) {
+                    // The counter reaches max_energy_range_uj and then wraps to 0.
+                    energy += domains[i].max_energy_range_uj - start_values[i] + value + 1;
+                }
+            }
+            return energy;
+        }
+    };
+}   // namespace mperf
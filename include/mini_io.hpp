@@ -0,0 +1,124 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <iostream>
+
+#include "linux-perf-events.h"
+#include "utilities.hpp"
+
+namespace mperf {
+    struct IoStats {
+        unsigned long long read_chars;
+        unsigned long long write_chars;
+        unsigned long long read_syscalls;
+        unsigned long long write_syscalls;
+        unsigned long long storage_read_bytes;
+        unsigned long long storage_write_bytes;
+    };
+
+    /// Sample the I/O statistics of the calling thread, io_reader reads /proc/thread-self/io.
+    /// A start sample includes the reads of the file itself, so that they are not counted in the
+    /// delta to the stop sample. All values are 0 on kernels without CONFIG_TASK_IO_ACCOUNTING.
+    inline void thread_io_stats(IoStats &stats, ProcFileReader &io_reader, bool start_sample) {
+        auto text = io_reader.read();
+        stats.read_chars = find_proc_value(text, "rchar");
+        stats.write_chars = find_proc_value(text, "wchar");
+        stats.read_syscalls = find_proc_value(text, "syscr");
+        stats.write_syscalls = find_proc_value(text, "syscw");
+        stats.storage_read_bytes = find_proc_value(text, "read_bytes");
+        stats.storage_write_bytes = find_proc_value(text, "write_bytes");
+        if (start_sample && !text.empty()) {
+            stats.read_chars += text.size();
+            stats.read_syscalls += io_reader.get_read_calls();
+        }
+    }
+
+    /// Get the change of an I/O metric between two samples.
+    inline unsigned long long io_metric_delta(int metric, const IoStats &start, const IoStats &stop) {
+        if (metric == MINI_READ_CHARS) {
+            return stop.read_chars - start.read_chars;
+        } else if (metric == MINI_WRITE_CHARS) {
+            return stop.write_chars - start.write_chars;
+        } else if (metric == MINI_READ_SYSCALLS) {
+            return stop.read_syscalls - start.read_syscalls;
+        } else if (metric == MINI_WRITE_SYSCALLS) {
+            return stop.write_syscalls - start.write_syscalls;
+        } else if (metric == MINI_STORAGE_READ_BYTES) {
+            return stop.storage_read_bytes - start.storage_read_bytes;
+        } else if (metric == MINI_STORAGE_WRITE_BYTES) {
+            return stop.storage_write_bytes - start.storage_write_bytes;
+        } else {
+            return 0;
+        }
+    }
+
+    /// Get the id of a tracepoint, e.g. "raw_syscalls/sys_enter", from tracefs. Returns -1 if
+    /// tracefs is not mounted or not readable.
+    inline int get_tracepoint_id(const std::string &tracepoint) {
+        for (auto root: {"/sys/kernel/tracing/events/", "/sys/kernel/debug/tracing/events/"}) {
+            std::ifstream id_stream(root + tracepoint + "/id", std::ios_base::in);
+            int id;
+            if (id_stream >> id) {
+                return id;
+            }
+        }
+        return -1;
+    }
+
+    /// Counts the syscalls of the calling thread with the raw_syscalls:sys_enter tracepoint.
+    /// Counting kernel events needs perf_event_paranoid <= 1 or CAP_PERFMON, and tracefs to look
+    /// up the tracepoint. Where that is not permitted a warning is printed and the count is 0.
+    class SyscallCounter {
+        std::unique_ptr<LinuxEvents<PERF_TYPE_TRACEPOINT>> events;
+        std::vector<unsigned long long> result = std::vector<unsigned long long>(1);
+
+        public:
+        SyscallCounter() {
+            auto id = get_tracepoint_id("raw_syscalls/sys_enter");
+            if (id == -1) {
+                std::cerr << "Cannot find the raw_syscalls:sys_enter tracepoint in tracefs, syscalls are 0." << std::endl;
+                return;
+            }
+            events = std::make_unique<LinuxEvents<PERF_TYPE_TRACEPOINT>>(std::vector<int>{id}, false);
+            if (!events->is_working()) {
+                events.reset();
+            }
+        }
+
+        SyscallCounter(const SyscallCounter &) = delete;
+
+        bool is_available() const {
+            return events != nullptr;
+        }
+
+        void start() {
+            if (events) {
+                events->start();
+            }
+        }
+
+        /// Syscalls since start(). The ioctl that stops the counter enters the kernel while the
+        /// counter is still enabled, so it is subtracted.
+        unsigned long long stop() {
+            if (!events) {
+                return 0;
+            }
+            events->end(result);
+            return result[0] > 0 ? result[0] - 1 : 0;
+        }
+
+        /// Bytes returned by the read() of stop(), which the I/O metrics count.
+        size_t read_bytes() const {
+            return events ? events->get_read_size() : 0;
+        }
+
+        void reopen() {
+            if (events) {
+                events->reopen();
+            }
+        }
+    };
+}   // namespace mperf
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace mperf {
+    /// Runs each benchmark repetition in a forked child process, so that every repetition starts
+    /// from the same process state: same heap, same allocator arenas, no threads of earlier
+    /// benchmarks. The child reports its averaged results back over a pipe and the parent
+    /// averages them across repetitions. Without isolation the body simply runs once in place.
+    class ForkIsolation {
+        bool isolated;
+        size_t repetitions;
+        int result_fd = -1;
+        std::vector<std::string> results;
+        std::vector<uint64_t> child_iterations;
+        long start_rss = 0;     // Max RSS of the child at fork, in KB.
+        long peak_rss = 0;
+
+        public:
+        explicit ForkIsolation(bool isolated = false, size_t repetitions = 1) : isolated(isolated),
+                                                                               repetitions(repetitions) {
+            if (isolated && repetitions == 0) {
+                throw (std::invalid_argument("Repetitions cannot be zero."));
+            }
+        }
+
+        size_t get_repetitions() const {
+            return isolated ? repetitions : 1;
+        }
+
+        /// Returns true if the benchmark body should run in this process. When isolated, the
+        /// parent forks a child, waits for its results and returns false, the child returns true.
+        template<typename Perf>
+        bool run_here(Perf &perf) {
+            if (!isolated) {
+                return true;
+            }
+            int pipe_fd[2];
+            if (pipe(pipe_fd) == -1) {
+                throw (std::runtime_error("pipe: " + std::string(strerror(errno))));
+            }
+            pid_t pid = fork();
+            if (pid == -1) {
+                throw (std::runtime_error("fork: " + std::string(strerror(errno))));
+            }
+            if (pid == 0) {
+                close(pipe_fd[0]);
+                result_fd = pipe_fd[1];
+                // The child starts with the resident pages of the parent, which the body did not allocate.
+                rusage usage{};
+                getrusage(RUSAGE_SELF, &usage);
+                start_rss = usage.ru_maxrss;
+                perf.reopen_counters();
+                return true;
+            }
+
+            close(pipe_fd[1]);
+            std::string message;
+            char buffer[4096];
+            ssize_t bytes;
+            while ((bytes = read(pipe_fd[0], buffer, sizeof(buffer))) != 0) {
+                if (bytes == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                message.append(buffer, bytes);
+            }
+            close(pipe_fd[0]);
+
+            int status = 0;
+            rusage usage{};
+            while (wait4(pid, &status, 0, &usage) == -1) {
+                if (errno != EINTR) {
+                    throw (std::runtime_error("wait4: " + std::string(strerror(errno))));
+                }
+            }
+            uint64_t iterations;
+            int64_t child_start_rss;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+                message.size() < sizeof(iterations) + sizeof(child_start_rss)) {
+                throw (std::runtime_error("Isolated benchmark child " + std::to_string(pid) + " failed."));
+            }
+            std::memcpy(&iterations, message.data(), sizeof(iterations));
+            std::memcpy(&child_start_rss, message.data() + sizeof(iterations), sizeof(child_start_rss));
+            child_iterations.push_back(iterations);
+            results.push_back(message.substr(sizeof(iterations) + sizeof(child_start_rss)));
+            peak_rss = std::max(peak_rss, usage.ru_maxrss - static_cast<long>(child_start_rss));
+            return false;
+        }
+
+        /// Called after the body has run. In an isolated child this sends the results to the
+        /// parent and exits without running atexit handlers or flushing inherited stdio buffers.
+        template<typename Perf>
+        void finish(Perf &perf, size_t iterations) {
+            if (result_fd == -1) {
+                return;
+            }
+            uint64_t count = iterations;
+            int64_t rss = start_rss;
+            std::string message(reinterpret_cast<const char *>(&count), sizeof(count));
+            message.append(reinterpret_cast<const char *>(&rss), sizeof(rss));
+            message += perf.serialize();
+            const char *ptr = message.data();
+            size_t remaining = message.size();
+            while (remaining > 0) {
+                ssize_t bytes = write(result_fd, ptr, remaining);
+                if (bytes == -1) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    _exit(1);
+                }
+                ptr += bytes;
+                remaining -= bytes;
+            }
+            close(result_fd);
+            _exit(0);
+        }
+
+        /// Called from a catch block when the body threw. In an isolated child this prints the
+        /// exception and exits with status 1, so that the parent reports the repetition as failed
+        /// instead of the child running the rest of the parent's program. Otherwise it returns.
+        void fail() {
+            if (result_fd == -1) {
+                return;
+            }
+            try {
+                throw;
+            } catch (const std::exception &e) {
+                std::cerr << "Isolated benchmark child " << getpid() << " threw: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Isolated benchmark child " << getpid() << " threw." << std::endl;
+            }
+            _exit(1);
+        }
+
+        /// Load the average of the children's results into perf in the parent.
+        template<typename Perf>
+        void collect(Perf &perf, size_t &iterations) {
+            if (!isolated) {
+                return;
+            }
+            perf.load_average(results);
+            uint64_t total = 0;
+            for (auto count: child_iterations) {
+                total += count;
+            }
+            iterations = total / child_iterations.size();
+            perf.add_custom_metric("Repetitions", std::to_string(results.size()));
+            perf.add_custom_metric("Peak RSS Growth(KB)", std::to_string(peak_rss));
+            results.clear();
+            child_iterations.clear();
+            peak_rss = 0;
+        }
+    };
+}   // namespace mperf
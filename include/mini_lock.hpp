@@ -0,0 +1,469 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
+#include <source_location>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace mperf {
+    /// Totals of a lock. Wait and hold times are in ns.
+    struct LockStats {
+        unsigned long long contended{};
+        unsigned long long uncontended{};
+        unsigned long long wait_ns{};
+        unsigned long long hold_ns{};
+    };
+
+    /// Totals of the acquisitions of a lock from one call site.
+    struct LockSiteStats {
+        std::string site;
+        LockStats stats;
+    };
+
+    /// Add the change of the statistics between two samples to total.
+    inline void add_lock_delta(LockStats &total, const LockStats &start, const LockStats &stop) {
+        total.contended += stop.contended - start.contended;
+        total.uncontended += stop.uncontended - start.uncontended;
+        total.wait_ns += stop.wait_ns - start.wait_ns;
+        total.hold_ns += stop.hold_ns - start.hold_ns;
+    }
+
+    /// Sort the statistics of the call sites by wait time.
+    inline std::vector<LockSiteStats> sort_lock_sites(const std::map<std::string, LockStats> &by_site) {
+        std::vector<LockSiteStats> result;
+        for (auto &[site, stats]: by_site) {
+            result.push_back({site, stats});
+        }
+        std::sort(result.begin(), result.end(), [](const LockSiteStats &a, const LockSiteStats &b) {
+            return a.stats.wait_ns > b.stats.wait_ns;
+        });
+        return result;
+    }
+
+    namespace lock_detail {
+        // Threads beyond max_thread_slots running at the same time share an overflow slot, which is
+        // updated atomically and does not keep call sites.
+        constexpr size_t max_thread_slots = 64;
+        constexpr size_t max_sites = 4;
+
+        /// Hands out the slot indices. The slot of an exited thread is given to the next new thread,
+        /// which continues its totals and call sites. The mutex orders the writes of the two threads.
+        class SlotAllocator {
+            std::mutex mutex;
+            std::vector<size_t> free_slots;
+            std::atomic<size_t> used{0};
+
+            public:
+            size_t acquire() {
+                std::lock_guard guard(mutex);
+                if (!free_slots.empty()) {
+                    auto slot = free_slots.back();
+                    free_slots.pop_back();
+                    return slot;
+                }
+                if (used.load(std::memory_order_relaxed) < max_thread_slots) {
+                    return used.fetch_add(1, std::memory_order_relaxed);
+                }
+                return max_thread_slots;
+            }
+
+            void release(size_t slot) {
+                if (slot < max_thread_slots) {
+                    std::lock_guard guard(mutex);
+                    free_slots.push_back(slot);
+                }
+            }
+
+            /// Number of slots handed out so far.
+            size_t get_used() const {
+                return used.load(std::memory_order_relaxed);
+            }
+        };
+
+        inline SlotAllocator &slot_allocator() {
+            static SlotAllocator allocator;
+            return allocator;
+        }
+
+        struct ThreadSlot {
+            size_t index;
+
+            ThreadSlot() : index(slot_allocator().acquire()) {}
+
+            ~ThreadSlot() {
+                slot_allocator().release(index);
+            }
+        };
+
+        inline size_t thread_slot() {
+            thread_local ThreadSlot slot;
+            return slot.index;
+        }
+
+        inline unsigned long long now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+
+        struct Counters {
+            std::atomic<unsigned long long> contended{};
+            std::atomic<unsigned long long> uncontended{};
+            std::atomic<unsigned long long> wait_ns{};
+            std::atomic<unsigned long long> hold_ns{};
+
+            void add_to(LockStats &stats) const {
+                stats.contended += contended.load(std::memory_order_relaxed);
+                stats.uncontended += uncontended.load(std::memory_order_relaxed);
+                stats.wait_ns += wait_ns.load(std::memory_order_relaxed);
+                stats.hold_ns += hold_ns.load(std::memory_order_relaxed);
+            }
+        };
+
+        struct Site {
+            std::atomic<const char *> file{};
+            std::atomic<unsigned> line{};
+            Counters counters;
+            // Hold time of releases by other threads than the acquiring one. It is kept apart from
+            // counters.hold_ns, whose plain stores by the owner would overwrite a concurrent add.
+            std::atomic<unsigned long long> foreign_hold_ns{};
+        };
+
+        /// Per-thread statistics. A slot has a single writer, so plain relaxed loads and stores
+        /// are enough, except for the shared overflow slot.
+        struct alignas(64) Slot {
+            Counters counters;
+            Site sites[max_sites];
+        };
+
+        /// A shared acquisition of a lock by the calling thread.
+        struct SharedHold {
+            const void *lock;
+            unsigned long long start;
+            Site *site;
+        };
+
+        /// The shared locks the calling thread holds, a thread can hold several.
+        inline std::vector<SharedHold> &shared_holds() {
+            thread_local std::vector<SharedHold> holds;
+            return holds;
+        }
+
+        inline void add(std::atomic<unsigned long long> &counter, unsigned long long value, bool shared) {
+            if (shared) {
+                counter.fetch_add(value, std::memory_order_relaxed);
+            } else {
+                counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+        }
+    }   // namespace lock_detail
+
+    /// Lock-free per-thread acquisition statistics of one instrumented lock. The slot of a thread is
+    /// allocated on its first acquisition, so a lock used by few threads stays small.
+    class LockProfile {
+        std::atomic<lock_detail::Slot *> slots[lock_detail::max_thread_slots]{};
+        lock_detail::Slot overflow;
+
+        /// The slot of the thread with the given index. Only that thread allocates it, readers skip
+        /// slots that are not allocated yet.
+        lock_detail::Slot &own_slot(size_t index) {
+            auto slot = slots[index].load(std::memory_order_relaxed);
+            if (slot == nullptr) {
+                slot = new lock_detail::Slot();
+                slots[index].store(slot, std::memory_order_release);
+            }
+            return *slot;
+        }
+
+        public:
+        const std::string name;
+
+        explicit LockProfile(std::string name) : name(std::move(name)) {}
+
+        LockProfile(const LockProfile &) = delete;
+
+        ~LockProfile() {
+            for (auto &slot: slots) {
+                delete slot.load(std::memory_order_relaxed);
+            }
+        }
+
+        /// Record an acquisition by the calling thread, returns the site to pass to released().
+        lock_detail::Site *acquired(bool contended, unsigned long long wait_ns, const std::source_location &location) {
+            auto index = lock_detail::thread_slot();
+            bool shared = index >= lock_detail::max_thread_slots;
+            auto &slot = shared ? overflow : own_slot(index);
+            auto &counters = slot.counters;
+            lock_detail::add(contended ? counters.contended : counters.uncontended, 1, shared);
+            lock_detail::add(counters.wait_ns, wait_ns, shared);
+            if (shared) {
+                return nullptr;
+            }
+
+            // Look up the call site, the last entry collects the sites that do not fit.
+            lock_detail::Site *site = &slot.sites[lock_detail::max_sites - 1];
+            for (size_t i = 0; i + 1 < lock_detail::max_sites; ++i) {
+                auto &entry = slot.sites[i];
+                auto file = entry.file.load(std::memory_order_relaxed);
+                if (file == nullptr) {
+                    entry.line.store(location.line(), std::memory_order_relaxed);
+                    entry.file.store(location.file_name(), std::memory_order_release);
+                    site = &entry;
+                    break;
+                }
+                if (file == location.file_name() && entry.line.load(std::memory_order_relaxed) == location.line()) {
+                    site = &entry;
+                    break;
+                }
+            }
+            if (site->file.load(std::memory_order_relaxed) == nullptr) {
+                site->file.store(location.file_name(), std::memory_order_release);
+            }
+            lock_detail::add(contended ? site->counters.contended : site->counters.uncontended, 1, false);
+            lock_detail::add(site->counters.wait_ns, wait_ns, false);
+            return site;
+        }
+
+        /// Record a release by the calling thread.
+        void released(lock_detail::Site *site, unsigned long long hold_ns) {
+            auto index = lock_detail::thread_slot();
+            bool shared = index >= lock_detail::max_thread_slots;
+            auto &slot = shared ? overflow : own_slot(index);
+            lock_detail::add(slot.counters.hold_ns, hold_ns, shared);
+            // The site belongs to the slot of the acquiring thread. A lock released by another
+            // thread, such as a spinlock handed over, adds to its foreign hold time atomically.
+            if (site != nullptr) {
+                bool own = !shared && site >= slot.sites && site < slot.sites + lock_detail::max_sites;
+                if (own) {
+                    lock_detail::add(site->counters.hold_ns, hold_ns, false);
+                } else {
+                    site->foreign_hold_ns.fetch_add(hold_ns, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /// Sum of the statistics of all threads so far. Safe to call while the lock is in use.
+        LockStats totals() const {
+            LockStats stats;
+            auto used = lock_detail::slot_allocator().get_used();
+            for (size_t i = 0; i < used; ++i) {
+                if (auto slot = slots[i].load(std::memory_order_acquire)) {
+                    slot->counters.add_to(stats);
+                }
+            }
+            overflow.counters.add_to(stats);
+            return stats;
+        }
+
+        /// Statistics per call site so far, sorted by wait time.
+        std::vector<LockSiteStats> sites() const {
+            std::map<std::string, LockStats> by_site;
+            site_totals(by_site);
+            return sort_lock_sites(by_site);
+        }
+
+        /// Sum of the statistics per call site so far, keyed by "file:line" or "Other".
+        void site_totals(std::map<std::string, LockStats> &by_site) const {
+            by_site.clear();
+            auto used = lock_detail::slot_allocator().get_used();
+            for (size_t i = 0; i < used; ++i) {
+                auto slot = slots[i].load(std::memory_order_acquire);
+                if (slot == nullptr) {
+                    continue;
+                }
+                for (size_t j = 0; j < lock_detail::max_sites; ++j) {
+                    auto &entry = slot->sites[j];
+                    auto file = entry.file.load(std::memory_order_acquire);
+                    if (file == nullptr) {
+                        continue;
+                    }
+                    auto site = j == lock_detail::max_sites - 1 ? std::string("Other") :
+                                std::string(file) + ":" + std::to_string(entry.line.load(std::memory_order_relaxed));
+                    auto &stats = by_site[site];
+                    entry.counters.add_to(stats);
+                    stats.hold_ns += entry.foreign_hold_ns.load(std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    /// Test and test-and-set spinlock.
+    class SpinLock {
+        std::atomic<bool> locked{false};
+
+        public:
+        void lock() {
+            while (locked.exchange(true, std::memory_order_acquire)) {
+                while (locked.load(std::memory_order_relaxed)) {
+                    lock_detail::cpu_relax();
+                }
+            }
+        }
+
+        bool try_lock() {
+            return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+        }
+
+        void unlock() {
+            locked.store(false, std::memory_order_release);
+        }
+    };
+
+    /// Drop-in replacement of std::mutex (or any Lockable) that records acquire wait time, hold
+    /// time, contended and uncontended acquisitions and the call sites. The uncontended fast path
+    /// is a try_lock, two clock reads, the thread slot lookup and a scan of the call sites. Note
+    /// that std::lock_guard and std::unique_lock call lock() from the standard headers, use
+    /// mperf::LockGuard to keep the call sites.
+    template<typename Mutex = std::mutex>
+    class InstrumentedMutex {
+        Mutex mutex;
+        LockProfile profile;
+        unsigned long long hold_start{};
+        lock_detail::Site *owner_site{};
+
+        public:
+        explicit InstrumentedMutex(std::string name = "Mutex") : profile(std::move(name)) {}
+
+        InstrumentedMutex(const InstrumentedMutex &) = delete;
+
+        void lock(const std::source_location &location = std::source_location::current()) {
+            if (mutex.try_lock()) {
+                owner_site = profile.acquired(false, 0, location);
+            } else {
+                auto wait_start = lock_detail::now_ns();
+                mutex.lock();
+                owner_site = profile.acquired(true, lock_detail::now_ns() - wait_start, location);
+            }
+            hold_start = lock_detail::now_ns();
+        }
+
+        bool try_lock(const std::source_location &location = std::source_location::current()) {
+            if (!mutex.try_lock()) {
+                return false;
+            }
+            owner_site = profile.acquired(false, 0, location);
+            hold_start = lock_detail::now_ns();
+            return true;
+        }
+
+        void unlock() {
+            profile.released(owner_site, lock_detail::now_ns() - hold_start);
+            mutex.unlock();
+        }
+
+        LockProfile &get_profile() {
+            return profile;
+        }
+    };
+
+    using InstrumentedSpinLock = InstrumentedMutex<SpinLock>;
+
+    /// Drop-in replacement of std::shared_mutex. Exclusive and shared acquisitions are counted
+    /// together.
+    class InstrumentedSharedMutex {
+        std::shared_mutex mutex;
+        LockProfile profile;
+        unsigned long long hold_start{};
+        lock_detail::Site *owner_site{};
+
+        public:
+        explicit InstrumentedSharedMutex(std::string name = "Shared Mutex") : profile(std::move(name)) {}
+
+        InstrumentedSharedMutex(const InstrumentedSharedMutex &) = delete;
+
+        void lock(const std::source_location &location = std::source_location::current()) {
+            if (mutex.try_lock()) {
+                owner_site = profile.acquired(false, 0, location);
+            } else {
+                auto wait_start = lock_detail::now_ns();
+                mutex.lock();
+                owner_site = profile.acquired(true, lock_detail::now_ns() - wait_start, location);
+            }
+            hold_start = lock_detail::now_ns();
+        }
+
+        bool try_lock(const std::source_location &location = std::source_location::current()) {
+            if (!mutex.try_lock()) {
+                return false;
+            }
+            owner_site = profile.acquired(false, 0, location);
+            hold_start = lock_detail::now_ns();
+            return true;
+        }
+
+        void unlock() {
+            profile.released(owner_site, lock_detail::now_ns() - hold_start);
+            mutex.unlock();
+        }
+
+        // Many threads hold the lock in shared mode at once, so the hold start is kept per thread.
+        void lock_shared(const std::source_location &location = std::source_location::current()) {
+            lock_detail::Site *site;
+            if (mutex.try_lock_shared()) {
+                site = profile.acquired(false, 0, location);
+            } else {
+                auto wait_start = lock_detail::now_ns();
+                mutex.lock_shared();
+                site = profile.acquired(true, lock_detail::now_ns() - wait_start, location);
+            }
+            lock_detail::shared_holds().push_back({this, lock_detail::now_ns(), site});
+        }
+
+        bool try_lock_shared(const std::source_location &location = std::source_location::current()) {
+            if (!mutex.try_lock_shared()) {
+                return false;
+            }
+            auto site = profile.acquired(false, 0, location);
+            lock_detail::shared_holds().push_back({this, lock_detail::now_ns(), site});
+            return true;
+        }
+
+        void unlock_shared() {
+            auto &holds = lock_detail::shared_holds();
+            auto hold = std::find_if(holds.rbegin(), holds.rend(), [this](const lock_detail::SharedHold &entry) {
+                return entry.lock == this;
+            });
+            if (hold != holds.rend()) {
+                profile.released(hold->site, lock_detail::now_ns() - hold->start);
+                holds.erase(std::next(hold).base());
+            }
+            mutex.unlock_shared();
+        }
+
+        LockProfile &get_profile() {
+            return profile;
+        }
+    };
+
+    /// std::lock_guard that records its own call site in the instrumented locks.
+    template<typename Lock>
+    class LockGuard {
+        Lock &lock;
+
+        public:
+        explicit LockGuard(Lock &lock, const std::source_location &location = std::source_location::current())
+                : lock(lock) {
+            lock.lock(location);
+        }
+
+        LockGuard(const LockGuard &) = delete;
+
+        ~LockGuard() {
+            lock.unlock();
+        }
+    };
+}   // namespace mperf
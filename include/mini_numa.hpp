@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "utilities.hpp"
+
+namespace mperf {
+    /// Get the online NUMA nodes from /sys/devices/system/node/online, {0} on kernels without NUMA.
+    inline std::vector<int> get_online_nodes() {
+        ProcFileReader reader("/sys/devices/system/node/online");
+        auto nodes = parse_id_list(reader.read());
+        if (nodes.empty()) {
+            nodes.push_back(0);
+        }
+        return nodes;
+    }
+
+    inline std::string get_numa_node_metric_name(int node) {
+        return "NUMA Node " + std::to_string(node) + " Pages";
+    }
+
+    /// Get the CPU and NUMA node the calling thread is running on.
+    inline void current_cpu_node(unsigned &cpu, unsigned &node) {
+        cpu = 0;
+        node = 0;
+        syscall(SYS_getcpu, &cpu, &node, nullptr);
+    }
+
+    struct NumaStats {
+        unsigned long long hit;
+        unsigned long long miss;
+    };
+
+    /// Samples the memory placement of the process, or of a tracked buffer, and the NUMA
+    /// allocation statistics of the nodes. Files are kept open between samples. On a machine with
+    /// a single node everything is counted on node 0, and without NUMA support the values are 0.
+    class NumaReader {
+        std::vector<int> nodes;
+        std::vector<std::unique_ptr<ProcFileReader>> numastat_readers;
+        ProcFileReader numa_maps_reader{"/proc/self/numa_maps"};
+        ProcFileReader smaps_rollup_reader{"/proc/self/smaps_rollup"};
+        const char *buffer{};
+        size_t buffer_bytes{};
+        std::vector<void *> buffer_pages;
+        std::vector<int> page_status;
+
+        /// Index of a node id in nodes, -1 if it is not online.
+        int node_index(long node) const {
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (nodes[i] == node) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+
+        // numa_maps has one line per mapping with "N<node>=<pages>" entries, counted in pages of
+        // "kernelpagesize_kB", which are converted to base pages.
+        void process_node_pages(std::vector<unsigned long long> &pages) {
+            auto text = numa_maps_reader.read();
+            auto base_page_kb = static_cast<unsigned long long>(sysconf(_SC_PAGE_SIZE) / 1024);
+            std::vector<std::pair<int, unsigned long long>> line_pages;
+            size_t line_start = 0;
+            while (line_start < text.size()) {
+                auto line_end = text.find('\n', line_start);
+                if (line_end == std::string_view::npos) {
+                    line_end = text.size();
+                }
+                auto line = text.substr(line_start, line_end - line_start);
+                line_start = line_end + 1;
+
+                line_pages.clear();
+                unsigned long long page_kb = base_page_kb;
+                size_t pos = 0;
+                while (pos < line.size()) {
+                    auto token_end = line.find(' ', pos);
+                    if (token_end == std::string_view::npos) {
+                        token_end = line.size();
+                    }
+                    auto token = line.substr(pos, token_end - pos);
+                    pos = token_end + 1;
+                    if (token.size() > 1 && token[0] == 'N' && token[1] >= '0' && token[1] <= '9') {
+                        size_t number_pos = 1;
+                        auto node = static_cast<int>(parse_proc_number(token, number_pos));
+                        if (number_pos < token.size() && token[number_pos] == '=') {
+                            number_pos += 1;
+                            line_pages.emplace_back(node, parse_proc_number(token, number_pos));
+                        }
+                    } else if (token.rfind("kernelpagesize_kB=", 0) == 0) {
+                        size_t number_pos = 18;
+                        page_kb = parse_proc_number(token, number_pos);
+                    }
+                }
+                for (auto &[node, count]: line_pages) {
+                    auto index = node_index(node);
+                    if (index >= 0) {
+                        pages[index] += count * page_kb / base_page_kb;
+                    }
+                }
+            }
+        }
+
+        // move_pages without target nodes only queries the node of every page. Pages that were
+        // never touched are not resident and not counted.
+        void buffer_node_pages(std::vector<unsigned long long> &pages) {
+            if (syscall(SYS_move_pages, 0, buffer_pages.size(), buffer_pages.data(), nullptr,
+                        page_status.data(), 0) != 0) {
+                return;
+            }
+            for (auto status: page_status) {
+                auto index = status >= 0 ? node_index(status) : -1;
+                if (index >= 0) {
+                    pages[index] += 1;
+                }
+            }
+        }
+
+        public:
+        NumaReader() : nodes(get_online_nodes()) {
+            for (auto node: nodes) {
+                numastat_readers.push_back(std::make_unique<ProcFileReader>(
+                        "/sys/devices/system/node/node" + std::to_string(node) + "/numastat"));
+            }
+        }
+
+        NumaReader(const NumaReader &) = delete;
+
+        const std::vector<int> &get_nodes() const {
+            return nodes;
+        }
+
+        /// Count the pages of [ptr, ptr + bytes) instead of the whole process.
+        void track_buffer(const void *ptr, size_t bytes) {
+            buffer = static_cast<const char *>(ptr);
+            buffer_bytes = bytes;
+            auto page_size = static_cast<uintptr_t>(sysconf(_SC_PAGE_SIZE));
+            auto first = reinterpret_cast<uintptr_t>(ptr) & ~(page_size - 1);
+            auto end = reinterpret_cast<uintptr_t>(ptr) + bytes;
+            buffer_pages.clear();
+            for (auto page = first; page < end; page += page_size) {
+                buffer_pages.push_back(reinterpret_cast<void *>(page));
+            }
+            page_status.assign(buffer_pages.size(), 0);
+        }
+
+        /// Resident pages per node, in the order of get_nodes(). Without a tracked buffer this parses
+        /// the whole numa_maps, about 100 us in a small process and more with many mappings.
+        void node_pages(std::vector<unsigned long long> &pages) {
+            pages.assign(nodes.size(), 0);
+            if (buffer != nullptr) {
+                buffer_node_pages(pages);
+            } else {
+                process_node_pages(pages);
+            }
+        }
+
+        /// Sum of numa_hit and numa_miss of all nodes.
+        void numa_stats(NumaStats &stats) {
+            stats = {};
+            for (auto &reader: numastat_readers) {
+                auto text = reader->read();
+                stats.hit += find_proc_value(text, "numa_hit");
+                stats.miss += find_proc_value(text, "numa_miss");
+            }
+        }
+
+        /// AnonHugePages of the process in KB.
+        unsigned long long anon_huge_pages() {
+            return find_proc_value(smaps_rollup_reader.read(), "AnonHugePages:");
+        }
+
+        /// Close the /proc/self files, e.g. in a forked child process.
+        void close_files() {
+            numa_maps_reader.close_file();
+            smaps_rollup_reader.close_file();
+        }
+    };
+}   // namespace mperf
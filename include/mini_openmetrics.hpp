@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+
+namespace mperf {
+    namespace openmetrics_detail {
+        /// Turn a metric name like "On CPU Time(ns)" into "on_cpu_time_ns".
+        inline std::string sanitize_name(const std::string &name) {
+            std::string result;
+            for (char c: name) {
+                if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+                    result += c;
+                } else if (c >= 'A' && c <= 'Z') {
+                    result += static_cast<char>(c - 'A' + 'a');
+                } else if (c == '%') {
+                    result += "percent";
+                } else if (!result.empty() && result.back() != '_') {
+                    result += '_';
+                }
+            }
+            while (!result.empty() && result.back() == '_') {
+                result.pop_back();
+            }
+            if (result.empty() || (result[0] >= '0' && result[0] <= '9')) {
+                result.insert(0, "_");
+            }
+            return result;
+        }
+
+        /// Escape a label value or HELP text: backslash, double quote and line feed.
+        inline std::string escape_label(const std::string &value) {
+            std::string result;
+            for (char c: value) {
+                if (c == '\\') {
+                    result += "\\\\";
+                } else if (c == '"') {
+                    result += "\\\"";
+                } else if (c == '\n') {
+                    result += "\\n";
+                } else {
+                    result += c;
+                }
+            }
+            return result;
+        }
+
+        /// Shortest representation that reads back as the same double.
+        inline std::string format_number(double value) {
+            char buffer[64];
+            auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            return {buffer, end};
+        }
+
+        struct Region {
+            unsigned long long count{};
+            unsigned long long timed_count{};   // Intervals with MINI_TIME_COUNT
+            double time_sum{};
+            std::vector<unsigned long long> time_buckets;
+            std::map<std::string, double> totals;   // Cumulative metrics and perf counters
+            std::map<std::string, double> gauges;   // Metrics that describe one interval, last value
+        };
+
+        // Derived ratios of two counter totals: name, numerator, denominator.
+        inline const std::vector<std::tuple<std::string, std::string, std::string>> &derived_ratios() {
+            static const std::vector<std::tuple<std::string, std::string, std::string>> ratios = {
+                    {"instructions_per_cycle", get_perf_metric_name(PERF_COUNT_HW_INSTRUCTIONS),
+                            get_perf_metric_name(PERF_COUNT_HW_CPU_CYCLES)},
+                    {"cache_miss_ratio", get_perf_metric_name(PERF_COUNT_HW_CACHE_MISSES),
+                            get_perf_metric_name(PERF_COUNT_HW_CACHE_REFERENCES)},
+                    {"branch_miss_ratio", get_perf_metric_name(PERF_COUNT_HW_BRANCH_MISSES),
+                            get_perf_metric_name(PERF_COUNT_HW_BRANCH_INSTRUCTIONS)},
+            };
+            return ratios;
+        }
+    }   // namespace openmetrics_detail
+
+    /// Aggregates the start/stop intervals of any number of MiniPerf instances per region and
+    /// exposes them in the OpenMetrics text format: a histogram of the region time, totals of the
+    /// perf counters and cumulative metrics, the last value of the other metrics and derived
+    /// ratios (IPC, cache and branch miss ratio) and average power. Regions are labelled with the
+    /// perf name.
+    ///
+    /// observe() only updates the aggregates under a short lock. A background publisher thread
+    /// renders them into an immutable snapshot every publish_interval when they changed, so
+    /// scrapes through get_snapshot(), write_textfile() or the HTTP endpoint only load a shared
+    /// pointer and never block the measured threads.
+    class OpenMetricsExporter {
+        std::string prefix;
+        std::vector<double> time_bounds;
+        std::chrono::steady_clock::duration publish_interval;
+        std::set<std::string> gauge_names;
+
+        std::mutex mutex;
+        std::map<std::string, openmetrics_detail::Region> regions;
+        unsigned long long version{};   // Incremented by every observe()
+        std::mutex publish_mutex;   // Keeps snapshots in order, taken by publishing threads only
+        unsigned long long published_version{};
+        std::atomic<std::shared_ptr<const std::string>> snapshot;
+
+        std::thread server;
+        std::atomic<bool> serving{false};
+        int server_fd = -1;
+
+        std::thread publisher;
+        std::mutex publisher_mutex;
+        std::condition_variable publisher_wakeup;
+        bool publishing{};
+
+        std::string render(const std::map<std::string, openmetrics_detail::Region> &copy) const;
+
+        void serve_loop();
+
+        void publish_loop();
+
+        public:
+        static constexpr const char *content_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+        /// time_buckets are the upper bounds of the time histogram in seconds. A zero publish_interval
+        /// starts no publisher thread, snapshots are then only rendered by publish().
+        explicit OpenMetricsExporter(std::string prefix = "mini_perf",
+                                     std::vector<double> time_buckets = {1e-6, 1e-5, 1e-4, 1e-3, 1e-2, 0.1, 1, 10},
+                                     std::chrono::milliseconds publish_interval = std::chrono::milliseconds(1000));
+
+        OpenMetricsExporter(const OpenMetricsExporter &) = delete;
+
+        ~OpenMetricsExporter() {
+            stop_server();
+            if (publisher.joinable()) {
+                {
+                    std::lock_guard<std::mutex> guard(publisher_mutex);
+                    publishing = false;
+                }
+                publisher_wakeup.notify_one();
+                publisher.join();
+            }
+        }
+
+        /// Add the last start/stop interval of perf to its region. Call it after stop().
+        template<typename Perf>
+        void observe(const Perf &perf) {
+            auto metrics = perf.get_last_metrics();
+            auto time_name = get_mini_metric_name(MINI_TIME_COUNT) + "(ns)";
+            std::lock_guard<std::mutex> guard(mutex);
+            auto &region = regions[perf.perf_name];
+            if (region.time_buckets.empty()) {
+                region.time_buckets.resize(time_bounds.size());
+            }
+            region.count += 1;
+            for (auto &[name, value]: metrics) {
+                if (name == time_name) {
+                    auto seconds = value / 1e9;
+                    region.timed_count += 1;
+                    region.time_sum += seconds;
+                    for (size_t i = 0; i < time_bounds.size(); ++i) {
+                        if (seconds <= time_bounds[i]) {
+                            region.time_buckets[i] += 1;
+                        }
+                    }
+                } else if (gauge_names.count(name)) {
+                    region.gauges[name] = value;
+                } else {
+                    region.totals[name] += value;
+                }
+            }
+            version += 1;
+        }
+
+        /// Render a new snapshot of the current aggregates now, e.g. before the last
+        /// write_textfile().
+        void publish();
+
+        /// The last published exposition, ending with "# EOF".
+        std::shared_ptr<const std::string> get_snapshot() const {
+            return snapshot.load();
+        }
+
+        /// Write the last snapshot to file_path for the node_exporter textfile collector. The text
+        /// is written to a temporary file in the same directory and renamed, so readers never see
+        /// a partial file.
+        void write_textfile(const std::string &file_path) const;
+
+        /// Serve the last snapshot over HTTP on 127.0.0.1:port from a background thread. Port 0
+        /// picks a free port. Returns the port.
+        unsigned short start_server(unsigned short port = 0);
+
+        void stop_server();
+    };
+
+    // Implementations
+    inline OpenMetricsExporter::OpenMetricsExporter(std::string prefix, std::vector<double> time_buckets,
+                                                    std::chrono::milliseconds publish_interval)
+            : prefix(openmetrics_detail::sanitize_name(prefix)), time_bounds(std::move(time_buckets)),
+              publish_interval(publish_interval) {
+        std::sort(time_bounds.begin(), time_bounds.end());
+        for (int metric = 0; metric <= static_cast<int>(MINI_ATTRIBUTE_MAX); ++metric) {
+            if (metric == MINI_TIME_COUNT || is_cumulative_metric(metric)) {
+                continue;
+            }
+            auto unit = get_mini_metric_unit(metric);
+            gauge_names.insert(unit.empty() ? get_mini_metric_name(metric) :
+                               get_mini_metric_name(metric) + "(" + unit + ")");
+        }
+        for (auto node: get_online_nodes()) {
+            gauge_names.insert(get_numa_node_metric_name(node));
+        }
+        snapshot.store(std::make_shared<const std::string>(render({})));
+        if (this->publish_interval > std::chrono::steady_clock::duration::zero()) {
+            publishing = true;
+            publisher = std::thread([this]() { publish_loop(); });
+        }
+    }
+
+    inline void OpenMetricsExporter::publish() {
+        std::lock_guard<std::mutex> publish_guard(publish_mutex);
+        std::map<std::string, openmetrics_detail::Region> copy;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            copy = regions;
+            published_version = version;
+        }
+        snapshot.store(std::make_shared<const std::string>(render(copy)));
+    }
+
+    inline void OpenMetricsExporter::publish_loop() {
+        std::unique_lock<std::mutex> lock(publisher_mutex);
+        while (!publisher_wakeup.wait_for(lock, publish_interval, [this]() { return !publishing; })) {
+            bool changed;
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                changed = version != published_version;
+            }
+            if (changed) {
+                publish();
+            }
+        }
+    }
+
+    inline std::string OpenMetricsExporter::render(
+            const std::map<std::string, openmetrics_detail::Region> &copy) const {
+        using openmetrics_detail::escape_label;
+        using openmetrics_detail::format_number;
+        using openmetrics_detail::sanitize_name;
+
+        std::string text;
+        auto label = [](const std::string &region_name) {
+            return "region=\"" + escape_label(region_name) + "\"";
+        };
+
+        // Observed intervals
+        auto count_family = prefix + "_region_observations";
+        text += "# TYPE " + count_family + " counter\n";
+        text += "# HELP " + count_family + " Observed start/stop intervals.\n";
+        for (auto &[region_name, region]: copy) {
+            text += count_family + "_total{" + label(region_name) + "} " + std::to_string(region.count) + "\n";
+        }
+
+        // Region time histogram
+        auto time_family = prefix + "_region_time_seconds";
+        text += "# TYPE " + time_family + " histogram\n";
+        text += "# UNIT " + time_family + " seconds\n";
+        text += "# HELP " + time_family + " Time between start() and stop().\n";
+        for (auto &[region_name, region]: copy) {
+            if (region.timed_count == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < time_bounds.size(); ++i) {
+                text += time_family + "_bucket{" + label(region_name) + ",le=\"" + format_number(time_bounds[i]) +
+                        "\"} " + std::to_string(region.time_buckets[i]) + "\n";
+            }
+            text += time_family + "_bucket{" + label(region_name) + ",le=\"+Inf\"} " +
+                    std::to_string(region.timed_count) + "\n";
+            text += time_family + "_sum{" + label(region_name) + "} " + format_number(region.time_sum) + "\n";
+            text += time_family + "_count{" + label(region_name) + "} " + std::to_string(region.timed_count) + "\n";
+        }
+
+        // Families must be contiguous, so collect the metric names of all regions first.
+        std::set<std::string> total_names, gauge_values;
+        for (auto &[region_name, region]: copy) {
+            for (auto &[name, _]: region.totals) {
+                total_names.insert(name);
+            }
+            for (auto &[name, _]: region.gauges) {
+                gauge_values.insert(name);
+            }
+        }
+        for (auto &name: total_names) {
+            auto family = prefix + "_" + sanitize_name(name);
+            text += "# TYPE " + family + " counter\n";
+            text += "# HELP " + family + " " + escape_label("Total " + name + ".") + "\n";
+            for (auto &[region_name, region]: copy) {
+                auto it = region.totals.find(name);
+                if (it != region.totals.end()) {
+                    text += family + "_total{" + label(region_name) + "} " + format_number(it->second) + "\n";
+                }
+            }
+        }
+        for (auto &name: gauge_values) {
+            auto family = prefix + "_" + sanitize_name(name);
+            text += "# TYPE " + family + " gauge\n";
+            text += "# HELP " + family + " " + escape_label(name + " of the last interval.") + "\n";
+            for (auto &[region_name, region]: copy) {
+                auto it = region.gauges.find(name);
+                if (it != region.gauges.end()) {
+                    text += family + "{" + label(region_name) + "} " + format_number(it->second) + "\n";
+                }
+            }
+        }
+
+        // Derived ratios of the totals
+        for (auto &[ratio_name, numerator, denominator]: openmetrics_detail::derived_ratios()) {
+            std::string samples;
+            for (auto &[region_name, region]: copy) {
+                auto num = region.totals.find(numerator), den = region.totals.find(denominator);
+                if (num != region.totals.end() && den != region.totals.end() && den->second > 0) {
+                    samples += prefix + "_" + ratio_name + "{" + label(region_name) + "} " +
+                               format_number(num->second / den->second) + "\n";
+                }
+            }
+            if (!samples.empty()) {
+                text += "# TYPE " + prefix + "_" + ratio_name + " gauge\n";
+                text += "# HELP " + prefix + "_" + ratio_name + " " +
+                        escape_label(numerator + " / " + denominator + ".") + "\n";
+                text += samples;
+            }
+        }
+
+        // Average power of the energy metrics over the region time
+        for (int metric: {MINI_ENERGY_PACKAGE, MINI_ENERGY_DRAM}) {
+            auto energy_name = get_mini_metric_name(metric) + "(" + get_mini_metric_unit(metric) + ")";
+            auto family = prefix + "_" + sanitize_name(get_power_metric_name(metric)) + "_watts";
+            std::string samples;
+            for (auto &[region_name, region]: copy) {
+                auto energy = region.totals.find(energy_name);
+                if (energy != region.totals.end() && region.time_sum > 0) {
+                    samples += family + "{" + label(region_name) + "} " +
+                               format_number(energy->second / region.time_sum) + "\n";
+                }
+            }
+            if (!samples.empty()) {
+                text += "# TYPE " + family + " gauge\n";
+                text += "# UNIT " + family + " watts\n";
+                text += "# HELP " + family + " " +
+                        escape_label("Average " + get_power_metric_name(metric) + " over the region time.") + "\n";
+                text += samples;
+            }
+        }
+
+        text += "# EOF\n";
+        return text;
+    }
+
+    inline void OpenMetricsExporter::write_textfile(const std::string &file_path) const {
+        auto text = get_snapshot();
+        auto tmp_path = file_path + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream file(tmp_path, std::ios::trunc);
+            file << *text;
+            if (!file) {
+                throw (std::runtime_error("Cannot write " + tmp_path));
+            }
+        }
+        if (std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            throw (std::runtime_error("rename " + file_path + ": " + std::string(strerror(errno))));
+        }
+    }
+
+    inline unsigned short OpenMetricsExporter::start_server(unsigned short port) {
+        if (serving) {
+            throw (std::runtime_error("The OpenMetrics server is already running."));
+        }
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (server_fd == -1) {
+            throw (std::runtime_error("socket: " + std::string(strerror(errno))));
+        }
+        int enable = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        socklen_t length = sizeof(address);
+        if (bind(server_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1 ||
+            listen(server_fd, 16) == -1 ||
+            getsockname(server_fd, reinterpret_cast<sockaddr *>(&address), &length) == -1) {
+            auto message = "bind 127.0.0.1:" + std::to_string(port) + ": " + std::string(strerror(errno));
+            close(server_fd);
+            server_fd = -1;
+            throw (std::runtime_error(message));
+        }
+        serving = true;
+        server = std::thread([this]() { serve_loop(); });
+        return ntohs(address.sin_port);
+    }
+
+    inline void OpenMetricsExporter::stop_server() {
+        if (!serving) {
+            return;
+        }
+        serving = false;
+        server.join();
+        close(server_fd);
+        server_fd = -1;
+    }
+
+    // One request per connection: GET /metrics (or /) returns the snapshot, anything else 404.
+    inline void OpenMetricsExporter::serve_loop() {
+        while (serving) {
+            pollfd poll_fd{server_fd, POLLIN, 0};
+            if (poll(&poll_fd, 1, 100) <= 0) {
+                continue;
+            }
+            int client = accept4(server_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client == -1) {
+                continue;
+            }
+            timeval timeout{1, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            std::string request;
+            char buffer[1024];
+            while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+                auto bytes = recv(client, buffer, sizeof(buffer), 0);
+                if (bytes <= 0) {
+                    break;
+                }
+                request.append(buffer, bytes);
+            }
+            std::string response;
+            if (request.rfind("GET /metrics ", 0) == 0 || request.rfind("GET / ", 0) == 0) {
+                auto text = get_snapshot();
+                response = "HTTP/1.1 200 OK\r\nContent-Type: " + std::string(content_type) +
+                           "\r\nContent-Length: " + std::to_string(text->size()) +
+                           "\r\nConnection: close\r\n\r\n" + *text;
+            } else {
+                response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            }
+            size_t sent = 0;
+            while (sent < response.size()) {
+                auto bytes = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (bytes <= 0) {
+                    break;
+                }
+                sent += bytes;
+            }
+            close(client);
+        }
+    }
+}   // namespace mperf
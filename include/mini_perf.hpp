@@ -6,8 +6,18 @@
 #include <fstream>
 #include <map>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
 
 #include "linux-perf-events.h"
+#include "mini_cache.hpp"
+#include "mini_energy.hpp"
+#include "mini_io.hpp"
+#include "mini_isolate.hpp"
+#include "mini_lock.hpp"
+#include "mini_numa.hpp"
 #include "mini_perf.hpp"
 #include "mini_perf_macro.hpp"
 #include "utilities.hpp"
@@ -25,16 +35,46 @@ namespace mperf {
         // Variables
         ClockTimePointType start_time;
         ClockDurationType time_count{};
+        ClockDurationType last_time_count{};
         double average_ipc{};
         std::tuple<int, int, double> cpu_usage; // user, system, usage
         std::vector<int> mini_attribute_metrics;
         std::vector<ull> mini_attribute_start;
         std::vector<ull> mini_attribute_count;
+        std::vector<ull> mini_attribute_last;
         LinuxEvents<> perf_events;
+        std::thread::id counter_thread{std::this_thread::get_id()};    // Thread the counters count.
         std::vector<int> perf_attribute_metrics;
         std::vector<ull> perf_attribute_start;
         std::vector<ull> perf_attribute_count;
         std::map<std::string, std::string> custom_metrics;
+        bool has_scheduler_metrics{};
+        bool has_cpu_migrations{};
+        SchedulerStats scheduler_start{};
+        ProcFileReader schedstat_reader{"/proc/thread-self/schedstat"};
+        ProcFileReader sched_reader{"/proc/thread-self/sched"};
+        std::vector<const LockProfile *> tracked_locks;
+        std::vector<LockStats> lock_start;
+        std::vector<LockStats> lock_count;
+        std::vector<std::map<std::string, LockStats>> lock_site_start;
+        std::vector<std::map<std::string, LockStats>> lock_site_count;
+        std::unique_ptr<EnergyReader> package_energy;
+        std::unique_ptr<EnergyReader> dram_energy;
+        ClockTimePointType energy_start_time;
+        ClockDurationType energy_time{};    // Time between start() and stop() of the energy metrics.
+        std::unique_ptr<NumaReader> numa_reader;
+        bool has_numa_stats{};
+        NumaStats numa_start{};
+        std::vector<ull> numa_node_pages;   // Per node of numa_reader, when stopped.
+        bool has_io_metrics{};
+        IoStats io_start{};
+        ProcFileReader io_reader{"/proc/thread-self/io"};
+        std::unique_ptr<SyscallCounter> syscall_counter;
+
+        double average_power(size_t ptr) const {
+            auto seconds = std::chrono::duration<double>(energy_time).count();
+            return seconds > 0 ? mini_attribute_count[ptr] / 1e6 / seconds : 0;
+        }
 
         
         public:
@@ -66,11 +106,69 @@ namespace mperf {
             return std::chrono::duration_cast<TimeDurationType>(time_count);
         }
 
+        /// The measured time in ns, not truncated to TimeDurationType.
+        std::chrono::nanoseconds get_time_count_ns() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(time_count);
+        }
+
         void metrics_average(size_t iterations);
 
         void add_custom_metric(const std::string &metric_name, const std::string &metric_value);
 
         void remove_custom_metric(const std::string &metric_name);
+
+        /// Get the names and values of the time, mini and perf metrics of the last start/stop
+        /// interval. The time is in ns.
+        std::vector<std::pair<std::string, double>> get_last_metrics() const;
+
+        /// Report the contention of an instrumented lock between start() and stop() with this
+        /// instance. The lock must outlive the instance.
+        void track_lock(const LockProfile &profile);
+
+        template<typename Lock>
+        requires requires(Lock &lock) { lock.get_profile(); }
+        void track_lock(Lock &lock) {
+            track_lock(lock.get_profile());
+        }
+
+        /// Count the MINI_NUMA_PAGES of [ptr, ptr + bytes) instead of the whole process. The
+        /// buffer must outlive the instance.
+        void track_numa_buffer(const void *ptr, size_t bytes);
+
+        /// Open the perf counters and per-thread readers again for the calling thread, e.g. in a
+        /// forked child process.
+        void reopen_counters();
+
+        /// The thread the counters and per-thread readers were opened on.
+        std::thread::id get_counter_thread() const {
+            return counter_thread;
+        }
+
+        /// False if the perf counters failed to open or to read, their results are 0 then.
+        bool counters_working() const {
+            return perf_events.is_working();
+        }
+
+        /// False if the RAPL or syscall readers of the energy and MINI_SYSCALLS metrics are
+        /// unavailable, these metrics are 0 then.
+        bool readers_working() const {
+            return (!package_energy || package_energy->is_available()) &&
+                   (!dram_energy || dram_energy->is_available()) &&
+                   (!syscall_counter || syscall_counter->is_available());
+        }
+
+        /// True if the kernel multiplexed the perf counters in the last start/stop interval,
+        /// so they only counted part of it.
+        bool counters_multiplexed() const {
+            return !perf_attribute_metrics.empty() && perf_events.is_multiplexed();
+        }
+
+        /// Serialize the results to a compact binary form, which can be sent to another process.
+        std::string serialize() const;
+
+        /// Replace the results with the average of serialized results from instances
+        /// constructed with the same metrics.
+        void load_average(const std::vector<std::string> &serialized_results);
     };
 
     // Implementations
@@ -113,6 +211,24 @@ namespace mperf {
                     throw (std::invalid_argument("Invalid mini parameter " + std::to_string(metric) + ": need dependency"));
                 }
             }
+            if (is_scheduler_metric(metric)) {
+                has_scheduler_metrics = true;
+                has_cpu_migrations |= metric == MINI_CPU_MIGRATIONS;
+            }
+            if (metric == MINI_ENERGY_PACKAGE && !package_energy) {
+                package_energy = std::make_unique<EnergyReader>(false);
+            } else if (metric == MINI_ENERGY_DRAM && !dram_energy) {
+                dram_energy = std::make_unique<EnergyReader>(true);
+            }
+            if (is_numa_metric(metric) && !numa_reader) {
+                numa_reader = std::make_unique<NumaReader>();
+                numa_node_pages.resize(numa_reader->get_nodes().size());
+            }
+            has_numa_stats |= metric == MINI_NUMA_HIT || metric == MINI_NUMA_MISS;
+            has_io_metrics |= is_io_metric(metric);
+            if (metric == MINI_SYSCALLS && !syscall_counter) {
+                syscall_counter = std::make_unique<SyscallCounter>();
+            }
             ptr += 1;
         }
 
@@ -123,6 +239,7 @@ namespace mperf {
         // Mini results
         mini_attribute_start.resize(mini_attribute_metrics.size());
         mini_attribute_count.resize(mini_attribute_metrics.size());
+        mini_attribute_last.resize(mini_attribute_metrics.size());
         ptr = 0;
         for (auto metric: mini_attribute_metrics) {
             if (metric == MINI_TIME_COUNT) {
@@ -139,17 +256,10 @@ namespace mperf {
 
     template<typename TimeDurationType>
     void MiniPerf<TimeDurationType>::start() {
-        // Perf results
-        if (!perf_attribute_metrics.empty()) {
-            perf_events.start();
-        }
-
-        // Mini results
+        // Mini results, the time is taken last
         int ptr = 0;
         for (auto metric: mini_attribute_metrics) {
-            if (metric == MINI_TIME_COUNT) {
-                start_time = ClockType::now();
-            } else if (metric == MINI_MEMORY_COUNT) {
+            if (metric == MINI_MEMORY_COUNT) {
                 double vm, rss;
                 process_mem_usage(vm, rss);
                 mini_attribute_start[ptr] = rss;
@@ -159,14 +269,59 @@ namespace mperf {
                 mini_attribute_start[ptr] = rss;
             } else if (metric == MINI_CPU_UTILIZATION) {
                 process_cpu_utilization(cpu_usage);
+            } else if (metric == MINI_ENERGY_PACKAGE) {
+                package_energy->start();
+            } else if (metric == MINI_ENERGY_DRAM) {
+                dram_energy->start();
             }
             ptr += 1;
         }
+        if (package_energy || dram_energy) {
+            energy_start_time = ClockType::now();
+        }
+
+        // Scheduler results
+        if (has_scheduler_metrics) {
+            thread_scheduler_stats(scheduler_start, schedstat_reader, has_cpu_migrations ? &sched_reader : nullptr);
+        }
+
+        // NUMA results
+        if (has_numa_stats) {
+            numa_reader->numa_stats(numa_start);
+        }
+
+        // Lock results
+        for (size_t i = 0; i < tracked_locks.size(); ++i) {
+            lock_start[i] = tracked_locks[i]->totals();
+            tracked_locks[i]->site_totals(lock_site_start[i]);
+        }
+
+        // I/O results, after all other reads of start() so that they are not counted
+        if (has_io_metrics) {
+            thread_io_stats(io_start, io_reader, true);
+        }
+
+        // Scheduler times, late so that the reads above are not counted
+        if (has_scheduler_metrics) {
+            thread_scheduler_clocks(scheduler_start, true);
+        }
+
+        // Syscall results, late so that the syscalls of start() are not counted
+        if (syscall_counter) {
+            syscall_counter->start();
+        }
+
+        // Perf results and time, last so that the work of start() is not counted
+        if (!perf_attribute_metrics.empty()) {
+            perf_events.start();
+        }
+        start_time = ClockType::now();
     }
 
     template<typename TimeDurationType>
     void MiniPerf<TimeDurationType>::stop() {
-        // Perf results
+        // Time and perf results, first so that the work of stop() is not counted
+        auto stop_time = ClockType::now();
         if (!perf_attribute_metrics.empty()) {
             perf_events.end(perf_attribute_start);
             for (int i = 0; i < perf_attribute_count.size(); ++i) {
@@ -174,11 +329,65 @@ namespace mperf {
             }
         }
 
+        // Syscall results, early so that the syscalls of stop() are not counted. The ioctls that
+        // start the perf counters and the ioctl and read() that stop them are subtracted.
+        ull syscalls = syscall_counter ? syscall_counter->stop() : 0;
+        if (!perf_attribute_metrics.empty()) {
+            syscalls = syscalls > 4 ? syscalls - 4 : 0;
+        }
+
+        // Scheduler times, early so that the reads below are not counted
+        SchedulerStats scheduler_stop{};
+        if (has_scheduler_metrics) {
+            thread_scheduler_clocks(scheduler_stop, false);
+        }
+
+        // I/O results, before the other reads of stop() so that they are not counted. Only the
+        // read() of the perf counters and of the syscall counter come before, and are subtracted.
+        IoStats io_stop{};
+        if (has_io_metrics) {
+            thread_io_stats(io_stop, io_reader, false);
+            if (!perf_attribute_metrics.empty() && perf_events.is_working()) {
+                io_stop.read_chars -= perf_events.get_read_size();
+                io_stop.read_syscalls -= 1;
+            }
+            if (syscall_counter && syscall_counter->is_available()) {
+                io_stop.read_chars -= syscall_counter->read_bytes();
+                io_stop.read_syscalls -= 1;
+            }
+        }
+
+        // Lock results
+        std::map<std::string, LockStats> lock_site_stop;
+        for (size_t i = 0; i < tracked_locks.size(); ++i) {
+            add_lock_delta(lock_count[i], lock_start[i], tracked_locks[i]->totals());
+            tracked_locks[i]->site_totals(lock_site_stop);
+            for (auto &[site, stats]: lock_site_stop) {
+                add_lock_delta(lock_site_count[i][site], lock_site_start[i][site], stats);
+            }
+        }
+
+        // Scheduler results
+        if (has_scheduler_metrics) {
+            thread_scheduler_stats(scheduler_stop, schedstat_reader, has_cpu_migrations ? &sched_reader : nullptr);
+        }
+
+        // NUMA results
+        NumaStats numa_stop{};
+        if (has_numa_stats) {
+            numa_reader->numa_stats(numa_stop);
+        }
+
         // Mini results
         int ptr = 0;
+        if (package_energy || dram_energy) {
+            energy_time += ClockType::now() - energy_start_time;
+        }
+        mini_attribute_last = mini_attribute_count;
         for (auto metric: mini_attribute_metrics) {
             if (metric == MINI_TIME_COUNT) {
-                time_count += ClockType::now() - start_time;
+                last_time_count = stop_time - start_time;
+                time_count += last_time_count;
             } else if (metric == MINI_MEMORY_COUNT) {
                 double vm, rss;
                 process_mem_usage(vm, rss);
@@ -224,9 +433,39 @@ namespace mperf {
             } else if (metric == MINI_CPU_UTILIZATION) {
                 process_cpu_utilization(cpu_usage);
                 mini_attribute_count[ptr] = std::get<2>(cpu_usage);
+            } else if (is_scheduler_metric(metric)) {
+                mini_attribute_count[ptr] += scheduler_metric_delta(metric, scheduler_start, scheduler_stop);
+            } else if (metric == MINI_ENERGY_PACKAGE) {
+                mini_attribute_count[ptr] += package_energy->stop();
+            } else if (metric == MINI_ENERGY_DRAM) {
+                mini_attribute_count[ptr] += dram_energy->stop();
+            } else if (metric == MINI_NUMA_PAGES) {
+                numa_reader->node_pages(numa_node_pages);
+                mini_attribute_count[ptr] = 0;
+                for (auto pages: numa_node_pages) {
+                    mini_attribute_count[ptr] += pages;
+                }
+            } else if (metric == MINI_ANON_HUGE_PAGES) {
+                mini_attribute_count[ptr] = numa_reader->anon_huge_pages();
+            } else if (metric == MINI_NUMA_HIT) {
+                mini_attribute_count[ptr] += numa_stop.hit - numa_start.hit;
+            } else if (metric == MINI_NUMA_MISS) {
+                mini_attribute_count[ptr] += numa_stop.miss - numa_start.miss;
+            } else if (metric == MINI_CURRENT_CPU || metric == MINI_CURRENT_NODE) {
+                unsigned cpu, node;
+                current_cpu_node(cpu, node);
+                mini_attribute_count[ptr] = metric == MINI_CURRENT_CPU ? cpu : node;
+            } else if (is_io_metric(metric)) {
+                mini_attribute_count[ptr] += io_metric_delta(metric, io_start, io_stop);
+            } else if (metric == MINI_SYSCALLS) {
+                mini_attribute_count[ptr] += syscalls;
             }
             ptr += 1;
         }
+        for (size_t i = 0; i < mini_attribute_metrics.size(); ++i) {
+            mini_attribute_last[i] = is_cumulative_metric(mini_attribute_metrics[i]) ?
+                                     mini_attribute_count[i] - mini_attribute_last[i] : mini_attribute_count[i];
+        }
     }
 
     template<typename TimeDurationType>
@@ -240,10 +479,20 @@ namespace mperf {
         // Mini results
         int ptr = 0;
         time_count = ClockDurationType::zero();
+        last_time_count = ClockDurationType::zero();
+        energy_time = ClockDurationType::zero();
         average_ipc = 0;
         cpu_usage = {0, 0, 0.0};
         std::fill(mini_attribute_start.begin(), mini_attribute_start.end(), 0);
         std::fill(mini_attribute_count.begin(), mini_attribute_count.end(), 0);
+        std::fill(mini_attribute_last.begin(), mini_attribute_last.end(), 0);
+        std::fill(numa_node_pages.begin(), numa_node_pages.end(), 0);
+
+        // Lock results
+        std::fill(lock_count.begin(), lock_count.end(), LockStats{});
+        for (auto &sites: lock_site_count) {
+            sites.clear();
+        }
 
         // Custom metrics
         custom_metrics.clear();
@@ -279,6 +528,20 @@ namespace mperf {
                 auto msg = get_mini_metric_name(metric) + ": " + std::to_string(average_ipc) +
                         get_mini_metric_unit(metric);
                 log_println(msg, to_stdout, to_file, file);
+            } else if (is_energy_metric(metric)) {
+                auto msg = get_mini_metric_name(metric) + ": " + std::to_string(mini_attribute_count[ptr] / 1e6) +
+                        get_mini_metric_unit(metric);
+                log_println(msg, to_stdout, to_file, file);
+                msg = get_power_metric_name(metric) + ": " + std::to_string(average_power(ptr)) + "W";
+                log_println(msg, to_stdout, to_file, file);
+            } else if (metric == MINI_NUMA_PAGES) {
+                auto msg = get_mini_metric_name(metric) + ": " + std::to_string(mini_attribute_count[ptr]);
+                log_println(msg, to_stdout, to_file, file);
+                for (size_t i = 0; i < numa_node_pages.size(); ++i) {
+                    msg = get_numa_node_metric_name(numa_reader->get_nodes()[i]) + ": " +
+                          std::to_string(numa_node_pages[i]);
+                    log_println(msg, to_stdout, to_file, file);
+                }
             } else {
                 auto msg = get_mini_metric_name(metric) + ": " + std::to_string(mini_attribute_count[ptr]) +
                         get_mini_metric_unit(metric);
@@ -295,6 +558,23 @@ namespace mperf {
             ptr += 1;
         }
 
+        // Lock results
+        for (size_t i = 0; i < tracked_locks.size(); ++i) {
+            auto &name = tracked_locks[i]->name;
+            auto &stats = lock_count[i];
+            log_println(name + " Contended: " + std::to_string(stats.contended), to_stdout, to_file, file);
+            log_println(name + " Uncontended: " + std::to_string(stats.uncontended), to_stdout, to_file, file);
+            log_println(name + " Wait Time: " + std::to_string(stats.wait_ns) + "ns", to_stdout, to_file, file);
+            log_println(name + " Hold Time: " + std::to_string(stats.hold_ns) + "ns", to_stdout, to_file, file);
+            for (auto &[site, site_stats]: sort_lock_sites(lock_site_count[i])) {
+                auto msg = name + " Site " + site + ": " + std::to_string(site_stats.contended) + " contended, " +
+                           std::to_string(site_stats.uncontended) + " uncontended, " +
+                           std::to_string(site_stats.wait_ns) + "ns wait, " +
+                           std::to_string(site_stats.hold_ns) + "ns hold";
+                log_println(msg, to_stdout, to_file, file);
+            }
+        }
+
         // Custom metrics
         for (auto &[metric_name, metric_value]: custom_metrics) {
             auto msg = metric_name + ": " + metric_value;
@@ -318,47 +598,51 @@ namespace mperf {
         }
         int ptr = 0;
 
-        // Print header if the file is empty
-        if (file.tellp() == 0) {
-            // Report info
-            {
-                auto perf_name_msg = "Name" + delimiter;
-                log_print(perf_name_msg, to_stdout, to_file, file);
-                auto report_name_msg = "Report Name" + delimiter;
-                log_print(report_name_msg, to_stdout, to_file, file);
-                auto report_time_msg = "Report Time" + delimiter;
-                log_print(report_time_msg, to_stdout, to_file, file);
-            }
-            // Mini metrics
-            ptr = 0;
-            for (auto metric: mini_attribute_metrics) {
-                if (metric == MINI_TIME_COUNT) {
-                    auto msg =
-                            get_mini_metric_name(metric) + "(" + get_time_unit<TimeDurationType>() + ")" + delimiter;
-                    log_print(msg, to_stdout, to_file, file);
-                } else if (metric == MINI_AVERAGE_IPC) {
-                    auto msg = get_mini_metric_name(metric) + delimiter;
-                    log_print(msg, to_stdout, to_file, file);
-                } else {
-                    auto msg = get_mini_metric_name(metric) + "(" + get_mini_metric_unit(metric) + ")" + delimiter;
-                    log_print(msg, to_stdout, to_file, file);
+        // Header
+        std::string header = "Name" + delimiter + "Report Name" + delimiter + "Report Time" + delimiter;
+        // Mini metrics
+        for (auto metric: mini_attribute_metrics) {
+            if (metric == MINI_TIME_COUNT) {
+                header += get_mini_metric_name(metric) + "(" + get_time_unit<TimeDurationType>() + ")" + delimiter;
+            } else if (metric == MINI_AVERAGE_IPC) {
+                header += get_mini_metric_name(metric) + delimiter;
+            } else if (is_energy_metric(metric)) {
+                header += get_mini_metric_name(metric) + "(" + get_mini_metric_unit(metric) + ")" + delimiter +
+                          get_power_metric_name(metric) + "(W)" + delimiter;
+            } else if (metric == MINI_NUMA_PAGES) {
+                header += get_mini_metric_name(metric) + delimiter;
+                for (auto node: numa_reader->get_nodes()) {
+                    header += get_numa_node_metric_name(node) + delimiter;
                 }
-                ptr += 1;
-            }
-            // Perf metrics
-            ptr = 0;
-            for (auto metric: perf_attribute_metrics) {
-                auto msg = get_perf_metric_name(metric) + delimiter;
-                log_print(msg, to_stdout, to_file, file);
-                ptr += 1;
+            } else {
+                header += get_mini_metric_name(metric) + "(" + get_mini_metric_unit(metric) + ")" + delimiter;
             }
-            // Custom metrics
-            for (auto &[metric_name, _]: custom_metrics) {
-                auto msg = metric_name + delimiter;
-                log_print(msg, to_stdout, to_file, file);
+        }
+        // Perf metrics
+        for (auto metric: perf_attribute_metrics) {
+            header += get_perf_metric_name(metric) + delimiter;
+        }
+        // Lock metrics
+        for (auto lock: tracked_locks) {
+            header += lock->name + " Contended" + delimiter + lock->name + " Uncontended" + delimiter +
+                      lock->name + " Wait Time(ns)" + delimiter + lock->name + " Hold Time(ns)" + delimiter;
+        }
+        // Custom metrics
+        for (auto &[metric_name, _]: custom_metrics) {
+            header += metric_name + delimiter;
+        }
+
+        // Print the header if the file is empty, or again if the row does not match the last header of the file
+        if (file.tellp() == 0) {
+            log_println(header, to_stdout, to_file, file);
+        } else if (to_file) {
+            auto &state = csv_header_states()[file_path];
+            auto last_header = state.end == file.tellp() ? state.header : last_csv_header(file_path, "Name" + delimiter);
+            if (last_header != header) {
+                std::cerr << "The columns of " << report_name << " do not match the last header of " << file_path
+                          << ", writing a new header." << std::endl;
+                log_println(header, to_stdout, to_file, file);
             }
-            // End of metrics
-            log_println("", to_stdout, to_file, file);
         }
 
         // Report info
@@ -380,6 +664,16 @@ namespace mperf {
             } else if (metric == MINI_AVERAGE_IPC) {
                 auto msg = std::to_string(average_ipc)+ delimiter;
                 log_print(msg, to_stdout, to_file, file);
+            } else if (is_energy_metric(metric)) {
+                auto msg = std::to_string(mini_attribute_count[ptr] / 1e6) + delimiter +
+                           std::to_string(average_power(ptr)) + delimiter;
+                log_print(msg, to_stdout, to_file, file);
+            } else if (metric == MINI_NUMA_PAGES) {
+                auto msg = std::to_string(mini_attribute_count[ptr]) + delimiter;
+                for (auto pages: numa_node_pages) {
+                    msg += std::to_string(pages) + delimiter;
+                }
+                log_print(msg, to_stdout, to_file, file);
             } else {
                 auto msg = std::to_string(mini_attribute_count[ptr]) + delimiter;
                 log_print(msg, to_stdout, to_file, file);
@@ -393,6 +687,13 @@ namespace mperf {
             log_print(msg, to_stdout, to_file, file);
             ptr += 1;
         }
+        // Lock results
+        for (auto &stats: lock_count) {
+            log_print(std::to_string(stats.contended) + delimiter, to_stdout, to_file, file);
+            log_print(std::to_string(stats.uncontended) + delimiter, to_stdout, to_file, file);
+            log_print(std::to_string(stats.wait_ns) + delimiter, to_stdout, to_file, file);
+            log_print(std::to_string(stats.hold_ns) + delimiter, to_stdout, to_file, file);
+        }
         // Custom metrics
         for (auto &[metric_name, metric_value]: custom_metrics) {
             auto msg = metric_value + delimiter;
@@ -402,6 +703,7 @@ namespace mperf {
         log_println("", to_stdout, to_file, file);
 
         if (to_file) {
+            csv_header_states()[file_path] = {file.tellp(), header};
             file.close();
         }
     }
@@ -415,15 +717,32 @@ namespace mperf {
         for (auto metric: mini_attribute_metrics) {
             if (metric == MINI_TIME_COUNT) {
                 time_count /= (iterations * 1.0);
-            } else if (metric == MINI_MEMORY_COUNT) {
+            } else if (is_cumulative_metric(metric)) {
                 mini_attribute_count[ptr] /= iterations;
             }
             ptr += 1;
         }
 
+        energy_time /= (iterations * 1.0);
+
         for (auto &metric: perf_attribute_count) {
             metric /= iterations;
         }
+
+        for (auto &stats: lock_count) {
+            stats.contended /= iterations;
+            stats.uncontended /= iterations;
+            stats.wait_ns /= iterations;
+            stats.hold_ns /= iterations;
+        }
+        for (auto &sites: lock_site_count) {
+            for (auto &[site, stats]: sites) {
+                stats.contended /= iterations;
+                stats.uncontended /= iterations;
+                stats.wait_ns /= iterations;
+                stats.hold_ns /= iterations;
+            }
+        }
     }
 
     template<typename TimeDurationType>
@@ -435,4 +754,221 @@ namespace mperf {
     void MiniPerf<TimeDurationType>::remove_custom_metric(const std::string &metric_name) {
         custom_metrics.erase(metric_name);
     }
+
+    template<typename TimeDurationType>
+    std::vector<std::pair<std::string, double>> MiniPerf<TimeDurationType>::get_last_metrics() const {
+        std::vector<std::pair<std::string, double>> metrics;
+        int ptr = 0;
+        for (auto metric: mini_attribute_metrics) {
+            if (metric == MINI_TIME_COUNT) {
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(last_time_count).count();
+                metrics.emplace_back(get_mini_metric_name(metric) + "(ns)", ns);
+            } else if (metric == MINI_AVERAGE_IPC) {
+                metrics.emplace_back(get_mini_metric_name(metric), average_ipc);
+            } else if (is_energy_metric(metric)) {
+                metrics.emplace_back(get_mini_metric_name(metric) + "(J)", mini_attribute_last[ptr] / 1e6);
+            } else if (metric == MINI_NUMA_PAGES) {
+                metrics.emplace_back(get_mini_metric_name(metric), mini_attribute_last[ptr]);
+                for (size_t i = 0; i < numa_node_pages.size(); ++i) {
+                    metrics.emplace_back(get_numa_node_metric_name(numa_reader->get_nodes()[i]), numa_node_pages[i]);
+                }
+            } else {
+                auto unit = get_mini_metric_unit(metric);
+                auto name = unit.empty() ? get_mini_metric_name(metric) : get_mini_metric_name(metric) + "(" + unit + ")";
+                metrics.emplace_back(name, mini_attribute_last[ptr]);
+            }
+            ptr += 1;
+        }
+        ptr = 0;
+        for (auto metric: perf_attribute_metrics) {
+            metrics.emplace_back(get_perf_metric_name(metric), perf_attribute_start[ptr]);
+            ptr += 1;
+        }
+        return metrics;
+    }
+
+    template<typename TimeDurationType>
+    void MiniPerf<TimeDurationType>::track_lock(const LockProfile &profile) {
+        tracked_locks.push_back(&profile);
+        lock_start.emplace_back();
+        lock_count.emplace_back();
+        lock_site_start.emplace_back();
+        lock_site_count.emplace_back();
+    }
+
+    template<typename TimeDurationType>
+    void MiniPerf<TimeDurationType>::reopen_counters() {
+        counter_thread = std::this_thread::get_id();
+        if (!perf_attribute_metrics.empty()) {
+            perf_events.reopen();
+        }
+        schedstat_reader.close_file();
+        sched_reader.close_file();
+        if (numa_reader) {
+            numa_reader->close_files();
+        }
+        io_reader.close_file();
+        if (syscall_counter) {
+            syscall_counter->reopen();
+        }
+    }
+
+    template<typename TimeDurationType>
+    void MiniPerf<TimeDurationType>::track_numa_buffer(const void *ptr, size_t bytes) {
+        if (std::find(mini_attribute_metrics.begin(), mini_attribute_metrics.end(), MINI_NUMA_PAGES) ==
+            mini_attribute_metrics.end()) {
+            throw (std::invalid_argument("MINI_NUMA_PAGES is not measured by " + perf_name));
+        }
+        numa_reader->track_buffer(ptr, bytes);
+    }
+
+    // Layout: time count, average IPC, mini results, perf results, lock results, energy time, NUMA node pages,
+    // then per tracked lock the number of call sites and each site as name length, name and results.
+    // Both sides are the same binary, so the native representation is used.
+    template<typename TimeDurationType>
+    std::string MiniPerf<TimeDurationType>::serialize() const {
+        std::string data;
+        auto ticks = static_cast<int64_t>(time_count.count());
+        data.append(reinterpret_cast<const char *>(&ticks), sizeof(ticks));
+        data.append(reinterpret_cast<const char *>(&average_ipc), sizeof(average_ipc));
+        data.append(reinterpret_cast<const char *>(mini_attribute_count.data()),
+                    mini_attribute_count.size() * sizeof(ull));
+        data.append(reinterpret_cast<const char *>(perf_attribute_count.data()),
+                    perf_attribute_count.size() * sizeof(ull));
+        data.append(reinterpret_cast<const char *>(lock_count.data()), lock_count.size() * sizeof(LockStats));
+        auto energy_ticks = static_cast<int64_t>(energy_time.count());
+        data.append(reinterpret_cast<const char *>(&energy_ticks), sizeof(energy_ticks));
+        data.append(reinterpret_cast<const char *>(numa_node_pages.data()), numa_node_pages.size() * sizeof(ull));
+        for (auto &sites: lock_site_count) {
+            uint64_t site_count = sites.size();
+            data.append(reinterpret_cast<const char *>(&site_count), sizeof(site_count));
+            for (auto &[site, stats]: sites) {
+                uint64_t length = site.size();
+                data.append(reinterpret_cast<const char *>(&length), sizeof(length));
+                data += site;
+                data.append(reinterpret_cast<const char *>(&stats), sizeof(stats));
+            }
+        }
+        return data;
+    }
+
+    template<typename TimeDurationType>
+    void MiniPerf<TimeDurationType>::load_average(const std::vector<std::string> &serialized_results) {
+        if (serialized_results.empty()) {
+            throw (std::invalid_argument("No results to average."));
+        }
+        double ticks_sum = 0, ipc_sum = 0, energy_ticks_sum = 0;
+        std::vector<double> mini_sum(mini_attribute_count.size()), perf_sum(perf_attribute_count.size()),
+                numa_sum(numa_node_pages.size());
+        std::vector<LockStats> lock_sum(lock_count.size());
+        std::vector<std::map<std::string, LockStats>> lock_site_sum(lock_count.size());
+        auto mismatch = std::invalid_argument("Serialized results do not match the metrics of " + perf_name);
+        for (auto &data: serialized_results) {
+            if (data.size() < 2 * sizeof(int64_t) + sizeof(double) +
+                              (mini_sum.size() + perf_sum.size() + numa_sum.size()) * sizeof(ull) +
+                              lock_sum.size() * (sizeof(LockStats) + sizeof(uint64_t))) {
+                throw (mismatch);
+            }
+            const char *ptr = data.data();
+            const char *end = data.data() + data.size();
+            int64_t ticks;
+            double ipc;
+            std::memcpy(&ticks, ptr, sizeof(ticks));
+            ptr += sizeof(ticks);
+            std::memcpy(&ipc, ptr, sizeof(ipc));
+            ptr += sizeof(ipc);
+            ticks_sum += ticks;
+            ipc_sum += ipc;
+            for (auto &sum: mini_sum) {
+                ull value;
+                std::memcpy(&value, ptr, sizeof(value));
+                ptr += sizeof(value);
+                sum += value;
+            }
+            for (auto &sum: perf_sum) {
+                ull value;
+                std::memcpy(&value, ptr, sizeof(value));
+                ptr += sizeof(value);
+                sum += value;
+            }
+            for (auto &sum: lock_sum) {
+                LockStats value;
+                std::memcpy(&value, ptr, sizeof(value));
+                ptr += sizeof(value);
+                sum.contended += value.contended;
+                sum.uncontended += value.uncontended;
+                sum.wait_ns += value.wait_ns;
+                sum.hold_ns += value.hold_ns;
+            }
+            int64_t energy_ticks;
+            std::memcpy(&energy_ticks, ptr, sizeof(energy_ticks));
+            ptr += sizeof(energy_ticks);
+            energy_ticks_sum += energy_ticks;
+            for (auto &sum: numa_sum) {
+                ull value;
+                std::memcpy(&value, ptr, sizeof(value));
+                ptr += sizeof(value);
+                sum += value;
+            }
+            for (auto &sites: lock_site_sum) {
+                uint64_t site_count, length;
+                if (end - ptr < static_cast<ptrdiff_t>(sizeof(site_count))) {
+                    throw (mismatch);
+                }
+                std::memcpy(&site_count, ptr, sizeof(site_count));
+                ptr += sizeof(site_count);
+                for (uint64_t i = 0; i < site_count; ++i) {
+                    if (end - ptr < static_cast<ptrdiff_t>(sizeof(length))) {
+                        throw (mismatch);
+                    }
+                    std::memcpy(&length, ptr, sizeof(length));
+                    ptr += sizeof(length);
+                    if (static_cast<uint64_t>(end - ptr) < length + sizeof(LockStats)) {
+                        throw (mismatch);
+                    }
+                    auto &sum = sites[std::string(ptr, length)];
+                    ptr += length;
+                    LockStats value;
+                    std::memcpy(&value, ptr, sizeof(value));
+                    ptr += sizeof(value);
+                    sum.contended += value.contended;
+                    sum.uncontended += value.uncontended;
+                    sum.wait_ns += value.wait_ns;
+                    sum.hold_ns += value.hold_ns;
+                }
+            }
+            if (ptr != end) {
+                throw (mismatch);
+            }
+        }
+        auto count = static_cast<double>(serialized_results.size());
+        time_count = ClockDurationType(static_cast<ClockDurationType::rep>(ticks_sum / count));
+        average_ipc = ipc_sum / count;
+        energy_time = ClockDurationType(static_cast<ClockDurationType::rep>(energy_ticks_sum / count));
+        for (size_t i = 0; i < mini_sum.size(); ++i) {
+            mini_attribute_count[i] = mini_sum[i] / count;
+        }
+        for (size_t i = 0; i < perf_sum.size(); ++i) {
+            perf_attribute_count[i] = perf_sum[i] / count;
+        }
+        for (size_t i = 0; i < numa_sum.size(); ++i) {
+            numa_node_pages[i] = numa_sum[i] / count;
+        }
+        for (size_t i = 0; i < lock_sum.size(); ++i) {
+            lock_count[i].contended = lock_sum[i].contended / serialized_results.size();
+            lock_count[i].uncontended = lock_sum[i].uncontended / serialized_results.size();
+            lock_count[i].wait_ns = lock_sum[i].wait_ns / serialized_results.size();
+            lock_count[i].hold_ns = lock_sum[i].hold_ns / serialized_results.size();
+        }
+        for (size_t i = 0; i < lock_site_sum.size(); ++i) {
+            lock_site_count[i].clear();
+            for (auto &[site, stats]: lock_site_sum[i]) {
+                auto &average = lock_site_count[i][site];
+                average.contended = stats.contended / serialized_results.size();
+                average.uncontended = stats.uncontended / serialized_results.size();
+                average.wait_ns = stats.wait_ns / serialized_results.size();
+                average.hold_ns = stats.hold_ns / serialized_results.size();
+            }
+        }
+    }
 }   // namespace mperf
\ No newline at end of file
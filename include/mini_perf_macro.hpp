@@ -39,32 +39,66 @@
 
 /// Macro for Mini Perf's Unit Benchmark. The initialization part should be done between the
 /// MiniInit and MiniEnd. The main part that you want to benchmark should
-/// be done between the MiniUnitStart and MiniUnitEnd. max_iteration_time's unit is second.
+/// be done between the MiniUnitStart and MiniUnitEnd. max_time's unit is second, it bounds the wall-clock
+/// time of each unit from MiniUnitStart, including the untimed cache preparation of the cold cache modes.
 #define MiniInit(perf_name, mini_metrics, perf_metrics, max_time)  \
+    MiniInitImpl(perf_name, mini_metrics, perf_metrics, max_time, false, 1)
+
+
+/// Same as MiniInit, but each unit runs `repetitions` times, each time in a freshly forked child
+/// process, and the averaged results of the children are reported.
+#define MiniInitIsolated(perf_name, mini_metrics, perf_metrics, max_time, repetitions)  \
+    MiniInitImpl(perf_name, mini_metrics, perf_metrics, max_time, true, repetitions)
+
+
+#define MiniInitImpl(perf_name, mini_metrics, perf_metrics, max_time, isolated, repetitions)  \
 {                                      \
     auto perf = mperf::MiniPerf<std::chrono::microseconds>{mini_metrics, perf_metrics, perf_name}; \
-    std::chrono::microseconds cur_time = std::chrono::microseconds{0};     \
     std::chrono::microseconds max_iteration_time = std::chrono::microseconds{max_time * 1000000}; \
     size_t iterations = 0;                      \
+    mperf::CacheControl cache_control{};        \
+    mperf::ForkIsolation isolation{isolated, repetitions}; \
 
 
 #define MiniUnitStart          \
-    {                                      \        
-        while(true) {                   \
-            perf.start();
+    {                                      \
+        for (size_t repetition = 0; repetition < isolation.get_repetitions(); ++repetition) { \
+            if (!isolation.run_here(perf)) continue; \
+            try {                           \
+            auto unit_start = std::chrono::steady_clock::now(); \
+            while(true) {                   \
+                cache_control.prepare();    \
+                perf.start();
 
 
 #define MiniUnitEnd(report_name, tofile, report_path) \
-            perf.stop();                            \
-            cur_time = perf.get_time_count();  \
-            iterations += 1;          \
-            if (cur_time > max_iteration_time) break; \
+                perf.stop();                            \
+                iterations += 1;          \
+                if (std::chrono::steady_clock::now() - unit_start > max_iteration_time) break; \
+            }                \
+            perf.metrics_average(iterations);                         \
+            isolation.finish(perf, iterations); \
+            } catch (...) {                 \
+                isolation.fail();           \
+                throw;                      \
+            }                               \
         }                \
-        perf.metrics_average(iterations);                         \
+        isolation.collect(perf, iterations); \
         perf.add_custom_metric("Iterations", std::to_string(iterations)); \
+        perf.add_custom_metric("Cache Mode", mperf::get_cache_mode_name(cache_control.get_mode())); \
         PerfReportInRow(perf, report_name, tofile, true, report_path)    \
         perf.reset(); \
+        iterations = 0; \
     }                                      \
 
 
+/// Macro for setting the cache mode (MINI_CACHE_WARM, MINI_CACHE_COLD, MINI_CACHE_TLB_COLD) of the
+/// following units. Cache preparation runs before each iteration and is excluded from the metrics.
+#define MiniCacheMode(mode) cache_control.set_mode(mode);
+
+
+/// Macro for declaring an input buffer to be flushed before each iteration in cold mode.
+#define MiniCacheBuffer(ptr, bytes) cache_control.add_buffer(ptr, bytes);
+
+
 #define MiniEnd }
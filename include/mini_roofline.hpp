@@ -0,0 +1,500 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+
+namespace mperf {
+    enum RoofLevel {
+        MINI_ROOF_L1 = 0,
+        MINI_ROOF_L2 = 1,
+        MINI_ROOF_LLC = 2,
+        MINI_ROOF_DRAM = 3,
+    };
+
+    inline std::string get_roof_level_name(int level) {
+        if (level == MINI_ROOF_L1) {
+            return "L1";
+        } else if (level == MINI_ROOF_L2) {
+            return "L2";
+        } else if (level == MINI_ROOF_LLC) {
+            return "LLC";
+        } else if (level == MINI_ROOF_DRAM) {
+            return "DRAM";
+        } else {
+            return "Unknown";
+        }
+    }
+
+    enum RoofIsa {
+        MINI_ROOF_SSE = 0,
+        MINI_ROOF_AVX2 = 1,
+        MINI_ROOF_AVX512 = 2,
+        MINI_ROOF_WIDEST = 3,   // The widest instruction set the machine supports.
+    };
+
+    /// Single core machine limits measured by the probe kernels. Unsupported instruction sets are 0.
+    struct MachineProfile {
+        std::string cpu_model;
+        double peak_gflops_sse{};
+        double peak_gflops_avx2{};
+        double peak_gflops_avx512{};
+        double bandwidth_gbs[4]{};  // Indexed by RoofLevel.
+
+        // Bumped whenever the probe kernels change, so that old profile files are probed again.
+        static constexpr int version = 2;
+
+        /// Peak GFLOP/s with the instruction set the measured kernel is compiled for.
+        double peak_gflops(RoofIsa isa = MINI_ROOF_WIDEST) const {
+            if (isa == MINI_ROOF_SSE) {
+                return peak_gflops_sse;
+            } else if (isa == MINI_ROOF_AVX2) {
+                return peak_gflops_avx2;
+            } else if (isa == MINI_ROOF_AVX512) {
+                return peak_gflops_avx512;
+            }
+            return std::max({peak_gflops_sse, peak_gflops_avx2, peak_gflops_avx512});
+        }
+
+        /// The attainable GFLOP/s at the given arithmetic intensity (FLOP/byte).
+        double roof(double intensity, RoofLevel level = MINI_ROOF_DRAM, RoofIsa isa = MINI_ROOF_WIDEST) const {
+            return std::min(peak_gflops(isa), intensity * bandwidth_gbs[level]);
+        }
+
+        void save(const std::string &file_path) const {
+            std::ofstream file(file_path, std::ios::trunc);
+            file << "version " << version << std::endl;
+            file << "cpu_model " << cpu_model << std::endl;
+            file << "peak_gflops_sse " << peak_gflops_sse << std::endl;
+            file << "peak_gflops_avx2 " << peak_gflops_avx2 << std::endl;
+            file << "peak_gflops_avx512 " << peak_gflops_avx512 << std::endl;
+            for (int level = MINI_ROOF_L1; level <= MINI_ROOF_DRAM; ++level) {
+                file << "bandwidth_gbs_" << get_roof_level_name(level) << " " << bandwidth_gbs[level] << std::endl;
+            }
+        }
+
+        /// Load a profile written by save(). Returns false if the file does not exist, was written
+        /// by another version of the probes, or is truncated or corrupted.
+        bool load(const std::string &file_path) {
+            std::ifstream file(file_path, std::ios_base::in);
+            if (!file) {
+                return false;
+            }
+            // Every value must be present and parse completely.
+            auto parse = [](const std::string &text, double &number) {
+                auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+                return error == std::errc() && end == text.data() + text.size();
+            };
+            std::string key, value;
+            bool current_version = false;
+            int values = 0;
+            while (file >> key && std::getline(file >> std::ws, value)) {
+                bool parsed = true;
+                if (key == "version") {
+                    current_version = value == std::to_string(version);
+                } else if (key == "cpu_model") {
+                    cpu_model = value;
+                } else if (key == "peak_gflops_sse") {
+                    parsed = parse(value, peak_gflops_sse);
+                    values += 1;
+                } else if (key == "peak_gflops_avx2") {
+                    parsed = parse(value, peak_gflops_avx2);
+                    values += 1;
+                } else if (key == "peak_gflops_avx512") {
+                    parsed = parse(value, peak_gflops_avx512);
+                    values += 1;
+                } else {
+                    for (int level = MINI_ROOF_L1; level <= MINI_ROOF_DRAM; ++level) {
+                        if (key == "bandwidth_gbs_" + get_roof_level_name(level)) {
+                            parsed = parse(value, bandwidth_gbs[level]);
+                            values += 1;
+                        }
+                    }
+                }
+                if (!parsed) {
+                    return false;
+                }
+            }
+            return current_version && values == 3 + MINI_ROOF_DRAM + 1;
+        }
+    };
+
+    namespace roofline_detail {
+        // Each probe runs for at least this long, the best of probe_repeats runs is kept.
+        constexpr auto probe_time = std::chrono::milliseconds(100);
+        constexpr int probe_repeats = 3;
+        constexpr int accumulators = 12;
+
+        /// Run kernel(iterations) with a growing iteration count until it takes probe_time,
+        /// then return the best work per second, where kernel returns the work it has done.
+        template<typename Kernel>
+        double best_rate(Kernel kernel) {
+            size_t iterations = 1;
+            while (true) {
+                auto begin = ClockType::now();
+                kernel(iterations);
+                if (ClockType::now() - begin > probe_time) {
+                    break;
+                }
+                iterations *= 2;
+            }
+            double best = 0;
+            for (int repeat = 0; repeat < probe_repeats; ++repeat) {
+                auto begin = ClockType::now();
+                double work = kernel(iterations);
+                std::chrono::duration<double> elapsed = ClockType::now() - begin;
+                best = std::max(best, work / elapsed.count());
+            }
+            return best;
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        // The accumulators converge to 1.0, which keeps the values away from denormals.
+        inline double sse_flops(size_t iterations) {
+            __m128d acc[accumulators];
+            for (auto &a: acc) {
+                a = _mm_set1_pd(0.5);
+            }
+            const __m128d mul = _mm_set1_pd(0.9999999), add = _mm_set1_pd(1e-7);
+            for (size_t i = 0; i < iterations; ++i) {
+                for (auto &a: acc) {
+                    a = _mm_add_pd(_mm_mul_pd(a, mul), add);
+                }
+            }
+            volatile double sink = 0;
+            for (auto &a: acc) {
+                sink = sink + _mm_cvtsd_f64(a);
+            }
+            return static_cast<double>(iterations) * accumulators * 2 * 2;
+        }
+
+        __attribute__((target("avx2,fma"))) inline double avx2_flops(size_t iterations) {
+            __m256d acc[accumulators];
+            for (auto &a: acc) {
+                a = _mm256_set1_pd(0.5);
+            }
+            const __m256d mul = _mm256_set1_pd(0.9999999), add = _mm256_set1_pd(1e-7);
+            for (size_t i = 0; i < iterations; ++i) {
+                for (auto &a: acc) {
+                    a = _mm256_fmadd_pd(a, mul, add);
+                }
+            }
+            volatile double sink = 0;
+            for (auto &a: acc) {
+                sink = sink + _mm256_cvtsd_f64(a);
+            }
+            return static_cast<double>(iterations) * accumulators * 4 * 2;
+        }
+
+        __attribute__((target("avx512f"))) inline double avx512_flops(size_t iterations) {
+            __m512d acc[accumulators];
+            for (auto &a: acc) {
+                a = _mm512_set1_pd(0.5);
+            }
+            const __m512d mul = _mm512_set1_pd(0.9999999), add = _mm512_set1_pd(1e-7);
+            for (size_t i = 0; i < iterations; ++i) {
+                for (auto &a: acc) {
+                    a = _mm512_fmadd_pd(a, mul, add);
+                }
+            }
+            volatile double sink = 0;
+            for (auto &a: acc) {
+                sink = sink + _mm512_cvtsd_f64(a);
+            }
+            return static_cast<double>(iterations) * accumulators * 8 * 2;
+        }
+
+        // The bandwidth kernels split the buffer into streams of a multiple of stream_align doubles,
+        // so that every vector load and store is aligned for any of the instruction sets. Streams
+        // start stream_align doubles after the end of the previous one, as streams a multiple of the
+        // page size apart alias in the store buffer and in the cache sets.
+        constexpr size_t stream_align = 32;
+
+        inline size_t stream_length(size_t count, size_t streams) {
+            return (count / streams - 2 * stream_align) / stream_align * stream_align;
+        }
+
+        /// Stream reads through the buffer iterations times and return the bytes read. The buffer is
+        /// read as four concurrent streams, as most kernels do, to keep the hardware prefetchers busy,
+        /// and summed into 16 independent accumulators so that the add latency stays hidden.
+        inline double sse_read_bytes(const double *data, size_t count, size_t iterations) {
+            __m128d acc[16];
+            for (auto &a: acc) {
+                a = _mm_setzero_pd();
+            }
+            size_t quarter = stream_length(count, 4), stride = quarter + stream_align;
+            for (size_t i = 0; i < iterations; ++i) {
+                for (size_t j = 0; j < quarter; j += 8) {
+                    for (int k = 0; k < 4; ++k) {
+                        for (int v = 0; v < 4; ++v) {
+                            acc[4 * k + v] = _mm_add_pd(acc[4 * k + v], _mm_load_pd(data + k * stride + j + 2 * v));
+                        }
+                    }
+                }
+                // Keeps the compiler from fusing iterations, which would skip memory traffic.
+                asm volatile("" : : : "memory");
+            }
+            volatile double sink = 0;
+            for (auto &a: acc) {
+                sink = sink + _mm_cvtsd_f64(a);
+            }
+            return static_cast<double>(iterations) * 4 * quarter * sizeof(double);
+        }
+
+        __attribute__((target("avx2"))) inline double avx2_read_bytes(const double *data, size_t count,
+                                                                      size_t iterations) {
+            __m256d acc[16];
+            for (auto &a: acc) {
+                a = _mm256_setzero_pd();
+            }
+            size_t quarter = stream_length(count, 4), stride = quarter + stream_align;
+            for (size_t i = 0; i < iterations; ++i) {
+                for (size_t j = 0; j < quarter; j += 16) {
+                    for (int k = 0; k < 4; ++k) {
+                        for (int v = 0; v < 4; ++v) {
+                            acc[4 * k + v] = _mm256_add_pd(acc[4 * k + v],
+                                                           _mm256_load_pd(data + k * stride + j + 4 * v));
+                        }
+                    }
+                }
+                asm volatile("" : : : "memory");
+            }
+            volatile double sink = 0;
+            for (auto &a: acc) {
+                sink = sink + _mm256_cvtsd_f64(a);
+            }
+            return static_cast<double>(iterations) * 4 * quarter * sizeof(double);
+        }
+
+        __attribute__((target("avx512f"))) inline double avx512_read_bytes(const double *data, size_t count,
+                                                                            size_t iterations) {
+            __m512d acc[16];
+            for (auto &a: acc) {
+                a = _mm512_setzero_pd();
+            }
+            size_t quarter = stream_length(count, 4), stride = quarter + stream_align;
+            for (size_t i = 0; i < iterations; ++i) {
+                for (size_t j = 0; j < quarter; j += 32) {
+                    for (int k = 0; k < 4; ++k) {
+                        for (int v = 0; v < 4; ++v) {
+                            acc[4 * k + v] = _mm512_add_pd(acc[4 * k + v],
+                                                           _mm512_load_pd(data + k * stride + j + 8 * v));
+                        }
+                    }
+                }
+                asm volatile("" : : : "memory");
+            }
+            volatile double sink = 0;
+            for (auto &a: acc) {
+                sink = sink + _mm512_cvtsd_f64(a);
+            }
+            return static_cast<double>(iterations) * 4 * quarter * sizeof(double);
+        }
+
+        /// Run y = a * x + y over the two halves of the buffer iterations times and return the bytes
+        /// moved, counted as two loads and one store per element like the regions count them.
+        inline double sse_update_bytes(double *data, size_t count, size_t iterations) {
+            size_t half = stream_length(count, 2);
+            double *x = data, *y = data + half + stream_align;
+            const __m128d a = _mm_set1_pd(1e-9);
+            for (size_t i = 0; i < iterations; ++i) {
+                for (size_t j = 0; j < half; j += 8) {
+                    for (int v = 0; v < 4; ++v) {
+                        auto offset = j + 2 * v;
+                        _mm_store_pd(y + offset, _mm_add_pd(_mm_mul_pd(a, _mm_load_pd(x + offset)),
+                                                            _mm_load_pd(y + offset)));
+                    }
+                }
+                asm volatile("" : : : "memory");
+            }
+            return static_cast<double>(iterations) * half * 3 * sizeof(double);
+        }
+
+        __attribute__((target("avx2,fma"))) inline double avx2_update_bytes(double *data, size_t count,
+                                                                            size_t iterations) {
+            size_t half = stream_length(count, 2);
+            double *x = data, *y = data + half + stream_align;
+            const __m256d a = _mm256_set1_pd(1e-9);
+            for (size_t i = 0; i < iterations; ++i) {
+                for (size_t j = 0; j < half; j += 16) {
+                    for (int v = 0; v < 4; ++v) {
+                        auto offset = j + 4 * v;
+                        _mm256_store_pd(y + offset, _mm256_fmadd_pd(a, _mm256_load_pd(x + offset),
+                                                                    _mm256_load_pd(y + offset)));
+                    }
+                }
+                asm volatile("" : : : "memory");
+            }
+            return static_cast<double>(iterations) * half * 3 * sizeof(double);
+        }
+
+        __attribute__((target("avx512f"))) inline double avx512_update_bytes(double *data, size_t count,
+                                                                             size_t iterations) {
+            size_t half = stream_length(count, 2);
+            double *x = data, *y = data + half + stream_align;
+            const __m512d a = _mm512_set1_pd(1e-9);
+            for (size_t i = 0; i < iterations; ++i) {
+                for (size_t j = 0; j < half; j += 32) {
+                    for (int v = 0; v < 4; ++v) {
+                        auto offset = j + 8 * v;
+                        _mm512_store_pd(y + offset, _mm512_fmadd_pd(a, _mm512_load_pd(x + offset),
+                                                                    _mm512_load_pd(y + offset)));
+                    }
+                }
+                asm volatile("" : : : "memory");
+            }
+            return static_cast<double>(iterations) * half * 3 * sizeof(double);
+        }
+#endif
+
+        /// The best bandwidth in GB/s of the read and the update kernel for a working set of the
+        /// given size. Every supported instruction set is tried, as wider stores are not always faster
+        /// beyond L2.
+        inline double stream_bandwidth(size_t bytes) {
+            // aligned_alloc needs a multiple of the alignment.
+            size_t count = std::max<size_t>(bytes / sizeof(double), 16 * stream_align);
+            count = (count + 4 * stream_align - 1) / (4 * stream_align) * (4 * stream_align);
+            auto *data = static_cast<double *>(std::aligned_alloc(64, count * sizeof(double)));
+            if (data == nullptr) {
+                throw (std::runtime_error("Cannot allocate the " + std::to_string(count * sizeof(double)) +
+                                          " bytes of a roofline bandwidth probe."));
+            }
+            std::fill(data, data + count, 1.0);
+            double read_rate = 0, update_rate = 0;
+#if defined(__x86_64__) || defined(__i386__)
+            read_rate = best_rate([&](size_t iterations) {
+                return sse_read_bytes(data, count, iterations);
+            });
+            update_rate = best_rate([&](size_t iterations) {
+                return sse_update_bytes(data, count, iterations);
+            });
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                read_rate = std::max(read_rate, best_rate([&](size_t iterations) {
+                    return avx2_read_bytes(data, count, iterations);
+                }));
+                update_rate = std::max(update_rate, best_rate([&](size_t iterations) {
+                    return avx2_update_bytes(data, count, iterations);
+                }));
+            }
+            if (__builtin_cpu_supports("avx512f")) {
+                read_rate = std::max(read_rate, best_rate([&](size_t iterations) {
+                    return avx512_read_bytes(data, count, iterations);
+                }));
+                update_rate = std::max(update_rate, best_rate([&](size_t iterations) {
+                    return avx512_update_bytes(data, count, iterations);
+                }));
+            }
+#else
+            read_rate = best_rate([&](size_t iterations) {
+                volatile double sink = 0;
+                double sum[8] = {};
+                for (size_t i = 0; i < iterations; ++i) {
+                    for (size_t j = 0; j < count; j += 8) {
+                        for (int v = 0; v < 8; ++v) {
+                            sum[v] += data[j + v];
+                        }
+                    }
+                    asm volatile("" : : : "memory");
+                }
+                for (auto value: sum) {
+                    sink = sink + value;
+                }
+                return static_cast<double>(iterations) * count * sizeof(double);
+            });
+            update_rate = best_rate([&](size_t iterations) {
+                size_t half = count / 2;
+                double *x = data, *y = data + half;
+                for (size_t i = 0; i < iterations; ++i) {
+                    for (size_t j = 0; j < half; ++j) {
+                        y[j] = 1e-9 * x[j] + y[j];
+                    }
+                    asm volatile("" : : : "memory");
+                }
+                return static_cast<double>(iterations) * half * 3 * sizeof(double);
+            });
+#endif
+            std::free(data);
+            return std::max(read_rate, update_rate) / 1e9;
+        }
+    }   // namespace roofline_detail
+
+    /// Run the built-in probe kernels on the calling thread. This takes up to half a minute.
+    inline MachineProfile probe_machine() {
+        using namespace roofline_detail;
+
+        MachineProfile profile;
+        profile.cpu_model = get_cpu_model();
+#if defined(__x86_64__) || defined(__i386__)
+        profile.peak_gflops_sse = best_rate(sse_flops) / 1e9;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            profile.peak_gflops_avx2 = best_rate(avx2_flops) / 1e9;
+        }
+        if (__builtin_cpu_supports("avx512f")) {
+            profile.peak_gflops_avx512 = best_rate(avx512_flops) / 1e9;
+        }
+#endif
+        // Half of L1 and L2 so that the working set stays resident. The LLC roof is the best of
+        // working sets from twice L2 to half the LLC, the DRAM roof is taken well beyond the LLC.
+        size_t l1 = get_cache_size(1), l2 = get_cache_size(2), llc = get_cache_size();
+        l1 = l1 ? l1 : 32 * 1024;
+        l2 = l2 ? l2 : 1024 * 1024;
+        profile.bandwidth_gbs[MINI_ROOF_L1] = stream_bandwidth(l1 / 2);
+        profile.bandwidth_gbs[MINI_ROOF_L2] = stream_bandwidth(l2 / 2);
+        size_t llc_end = llc ? llc / 2 : 8 * l2;
+        for (size_t bytes = 2 * l2; bytes <= llc_end; bytes *= 4) {
+            profile.bandwidth_gbs[MINI_ROOF_LLC] = std::max(profile.bandwidth_gbs[MINI_ROOF_LLC],
+                                                            stream_bandwidth(bytes));
+        }
+        if (profile.bandwidth_gbs[MINI_ROOF_LLC] == 0) {
+            // No cache level beyond L2.
+            profile.bandwidth_gbs[MINI_ROOF_LLC] = profile.bandwidth_gbs[MINI_ROOF_L2];
+        }
+        profile.bandwidth_gbs[MINI_ROOF_DRAM] = stream_bandwidth(std::max<size_t>(4 * llc, 256 * 1024 * 1024));
+        return profile;
+    }
+
+    /// Load the machine profile from file_path, probing the machine and caching the result to
+    /// file_path if the file is missing, was written on a different CPU model or by older probes.
+    inline MachineProfile load_machine_profile(const std::string &file_path = "./mini_perf_machine.profile") {
+        MachineProfile profile;
+        if (profile.load(file_path) && profile.cpu_model == get_cpu_model()) {
+            return profile;
+        }
+        profile = probe_machine();
+        profile.save(file_path);
+        return profile;
+    }
+
+    /// Add the roofline placement of the measured region to the custom metrics of perf. flops and
+    /// bytes are the work done during the measured time, i.e. per iteration after metrics_average().
+    /// The region is compared with the roof of the memory level its working set lives in and of
+    /// the instruction set it is compiled for.
+    template<typename TimeDurationType>
+    void add_roofline_metrics(MiniPerf<TimeDurationType> &perf, const MachineProfile &profile, double flops,
+                              double bytes, RoofLevel level = MINI_ROOF_DRAM, RoofIsa isa = MINI_ROOF_WIDEST) {
+        double seconds = std::chrono::duration<double>(perf.get_time_count_ns()).count();
+        if (seconds <= 0 || bytes <= 0) {
+            throw (std::invalid_argument("Roofline metrics need MINI_TIME_COUNT and a non-zero byte count."));
+        }
+        double intensity = flops / bytes;
+        double gflops = flops / seconds / 1e9;
+        double roof = profile.roof(intensity, level, isa);
+        perf.add_custom_metric("Arithmetic Intensity(FLOP/B)", std::to_string(intensity));
+        perf.add_custom_metric("Performance(GFLOP/s)", std::to_string(gflops));
+        perf.add_custom_metric("Bandwidth(GB/s)", std::to_string(bytes / seconds / 1e9));
+        perf.add_custom_metric("Roof " + get_roof_level_name(level) + "(GFLOP/s)", std::to_string(roof));
+        perf.add_custom_metric("Roof Usage(%)", std::to_string(roof > 0 ? gflops * 100 / roof : 0.0));
+    }
+}   // namespace mperf
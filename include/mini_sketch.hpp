@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+
+namespace mperf {
+    /// Quantile sketch with relative accuracy guarantees (DDSketch). Values are counted in
+    /// logarithmic buckets, so two sketches with the same accuracy merge exactly by adding their
+    /// bucket counts, and every quantile is within relative_accuracy of the true value.
+    class QuantileSketch {
+        double relative_accuracy;
+        double gamma;
+        double log_gamma;
+        std::map<int, unsigned long long> buckets;
+        unsigned long long zero_count{};
+        unsigned long long count{};
+
+        public:
+        // Values at or below this are counted as zero, counters and times are never negative.
+        static constexpr double min_value = 1e-9;
+
+        explicit QuantileSketch(double relative_accuracy = 0.01) : relative_accuracy(relative_accuracy) {
+            if (relative_accuracy <= 0 || relative_accuracy >= 1) {
+                throw (std::invalid_argument("Relative accuracy must be in (0, 1)."));
+            }
+            gamma = (1 + relative_accuracy) / (1 - relative_accuracy);
+            log_gamma = std::log(gamma);
+        }
+
+        void add(double value, unsigned long long times = 1) {
+            count += times;
+            if (value <= min_value) {
+                zero_count += times;
+            } else {
+                buckets[static_cast<int>(std::ceil(std::log(value) / log_gamma))] += times;
+            }
+        }
+
+        void merge(const QuantileSketch &other) {
+            if (other.relative_accuracy != relative_accuracy) {
+                throw (std::invalid_argument("Cannot merge sketches with different accuracies."));
+            }
+            count += other.count;
+            zero_count += other.zero_count;
+            for (auto &[index, bucket_count]: other.buckets) {
+                buckets[index] += bucket_count;
+            }
+        }
+
+        /// Get the q-quantile, q in [0, 1]. Returns 0 for an empty sketch.
+        double quantile(double q) const {
+            if (count == 0) {
+                return 0;
+            }
+            auto rank = static_cast<unsigned long long>(std::clamp(q, 0.0, 1.0) * (count - 1));
+            if (rank < zero_count) {
+                return 0;
+            }
+            unsigned long long seen = zero_count;
+            for (auto &[index, bucket_count]: buckets) {
+                seen += bucket_count;
+                if (seen > rank) {
+                    return 2 * std::pow(gamma, index) / (gamma + 1);
+                }
+            }
+            return 2 * std::pow(gamma, buckets.rbegin()->first) / (gamma + 1);
+        }
+
+        unsigned long long get_count() const {
+            return count;
+        }
+
+        /// One line: accuracy, zero count, bucket count, then index/count pairs.
+        void save(std::ostream &out) const {
+            out.precision(17);
+            out << relative_accuracy << " " << zero_count << " " << buckets.size();
+            for (auto &[index, bucket_count]: buckets) {
+                out << " " << index << " " << bucket_count;
+            }
+            out << "\n";
+        }
+
+        static QuantileSketch load(std::istream &in) {
+            double accuracy;
+            unsigned long long zeros;
+            size_t size;
+            if (!(in >> accuracy >> zeros >> size)) {
+                throw (std::runtime_error("Invalid sketch."));
+            }
+            QuantileSketch sketch(accuracy);
+            sketch.zero_count = zeros;
+            sketch.count = zeros;
+            for (size_t i = 0; i < size; ++i) {
+                int index;
+                unsigned long long bucket_count;
+                if (!(in >> index >> bucket_count)) {
+                    throw (std::runtime_error("Invalid sketch."));
+                }
+                sketch.buckets[index] = bucket_count;
+                sketch.count += bucket_count;
+            }
+            return sketch;
+        }
+    };
+
+    /// Count, sum, min, max and quantiles of one metric.
+    struct MetricSummary {
+        unsigned long long count{};
+        double sum{};
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        QuantileSketch sketch;
+
+        void add(double value) {
+            count += 1;
+            sum += value;
+            min = std::min(min, value);
+            max = std::max(max, value);
+            sketch.add(value);
+        }
+
+        void merge(const MetricSummary &other) {
+            count += other.count;
+            sum += other.sum;
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            sketch.merge(other.sketch);
+        }
+
+        double mean() const {
+            return count == 0 ? 0 : sum / count;
+        }
+
+        /// The sketch quantile, clamped to the exact min and max.
+        double quantile(double q) const {
+            return count == 0 ? 0 : std::clamp(sketch.quantile(q), min, max);
+        }
+    };
+
+    /// Mergeable per-region summaries of the metrics of every start/stop interval. Summaries of
+    /// any number of processes or hosts can be saved, merged and reported with correct quantiles.
+    class PerfSummary {
+        // region name -> metric name -> summary
+        std::map<std::string, std::map<std::string, MetricSummary>> regions;
+
+        public:
+        static constexpr const char *file_header = "mini_perf_summary 2";
+
+        /// Add the last interval of perf to the region named after perf. Call it after stop().
+        template<typename Perf>
+        void record(const Perf &perf) {
+            auto &region = regions[perf.perf_name];
+            for (auto &[metric_name, value]: perf.get_last_metrics()) {
+                region[metric_name].add(value);
+            }
+        }
+
+        void add(const std::string &region_name, const std::string &metric_name, double value) {
+            regions[region_name][metric_name].add(value);
+        }
+
+        void merge(const PerfSummary &other) {
+            for (auto &[region_name, metrics]: other.regions) {
+                for (auto &[metric_name, summary]: metrics) {
+                    regions[region_name][metric_name].merge(summary);
+                }
+            }
+        }
+
+        const std::map<std::string, std::map<std::string, MetricSummary>> &get_regions() const {
+            return regions;
+        }
+
+        // Text format, names are on their own lines so that they may contain spaces:
+        //   mini_perf_summary 2
+        //   region <name>
+        //   metric <name>
+        //   <count> <sum> <min> <max>
+        //   <sketch>
+        //   end <region count> <metric count>
+        // The end line tells a complete file from one a crashed process cut between records.
+        void save(const std::string &file_path) const {
+            std::ofstream file(file_path, std::ios::trunc);
+            file.precision(17);
+            file << file_header << "\n";
+            size_t metric_count = 0;
+            for (auto &[region_name, metrics]: regions) {
+                file << "region " << region_name << "\n";
+                for (auto &[metric_name, summary]: metrics) {
+                    metric_count += 1;
+                    file << "metric " << metric_name << "\n";
+                    file << summary.count << " " << summary.sum << " " << summary.min << " " << summary.max << "\n";
+                    summary.sketch.save(file);
+                }
+            }
+            file << "end " << regions.size() << " " << metric_count << "\n";
+        }
+
+        static PerfSummary load(const std::string &file_path) {
+            std::ifstream file(file_path, std::ios_base::in);
+            std::string line;
+            if (!std::getline(file, line) || line != file_header) {
+                throw (std::runtime_error("Not a Mini Perf summary file: " + file_path));
+            }
+            PerfSummary summary;
+            std::map<std::string, MetricSummary> *region = nullptr;
+            size_t region_count = 0, metric_count = 0;
+            bool complete = false;
+            while (std::getline(file, line)) {
+                if (complete && !line.empty()) {
+                    throw (std::runtime_error("Data after the end line in " + file_path + ": " + line));
+                } else if (line.rfind("end ", 0) == 0) {
+                    std::istringstream counts(line.substr(4));
+                    size_t saved_regions, saved_metrics;
+                    if (!(counts >> saved_regions >> saved_metrics) || !(counts >> std::ws).eof() ||
+                        saved_regions != region_count || saved_metrics != metric_count) {
+                        throw (std::runtime_error("Invalid end line in " + file_path + ": " + line));
+                    }
+                    complete = true;
+                } else if (line.rfind("region ", 0) == 0) {
+                    region_count += 1;
+                    region = &summary.regions[line.substr(7)];
+                } else if (line.rfind("metric ", 0) == 0 && region != nullptr) {
+                    // A file of a crashed process may end anywhere, the count of the stats line
+                    // has to match the complete sketch line.
+                    metric_count += 1;
+                    auto metric_name = line.substr(7);
+                    auto &metric = (*region)[metric_name];
+                    std::string stats_line, sketch_line;
+                    bool valid = std::getline(file, stats_line) && std::getline(file, sketch_line);
+                    if (valid) {
+                        std::istringstream stats(stats_line);
+                        valid = (stats >> metric.count >> metric.sum >> metric.min >> metric.max) &&
+                                (stats >> std::ws).eof();
+                    }
+                    if (valid) {
+                        try {
+                            std::istringstream sketch(sketch_line);
+                            metric.sketch = QuantileSketch::load(sketch);
+                            valid = (sketch >> std::ws).eof() && metric.sketch.get_count() == metric.count;
+                        } catch (const std::runtime_error &) {
+                            valid = false;
+                        }
+                    }
+                    if (!valid) {
+                        throw (std::runtime_error("Truncated or invalid metric " + metric_name + " in " + file_path));
+                    }
+                } else if (!line.empty()) {
+                    throw (std::runtime_error("Invalid line in " + file_path + ": " + line));
+                }
+            }
+            if (!complete) {
+                throw (std::runtime_error("Truncated summary file, no end line: " + file_path));
+            }
+            return summary;
+        }
+
+        /// Report one row per region and metric with count, mean, min, max and quantiles.
+        void report(bool to_file = false, bool to_stdout = true, const std::string &file_path = "./mini_perf_summary.csv",
+                    const std::string &delimiter = ",") const {
+            std::ofstream file;
+            if (to_file) {
+                file = std::ofstream(file_path, std::ios::app);
+            }
+            std::string header;
+            for (auto column: {"Region", "Metric", "Count", "Mean", "Min", "Max", "P50", "P90", "P99", "P99.9"}) {
+                header += column + delimiter;
+            }
+            log_println(header, to_stdout, to_file, file);
+            for (auto &[region_name, metrics]: regions) {
+                for (auto &[metric_name, summary]: metrics) {
+                    auto msg = region_name + delimiter + metric_name + delimiter +
+                               std::to_string(summary.count) + delimiter + std::to_string(summary.mean()) + delimiter +
+                               std::to_string(summary.min) + delimiter + std::to_string(summary.max) + delimiter;
+                    for (auto q: {0.5, 0.9, 0.99, 0.999}) {
+                        msg += std::to_string(summary.quantile(q)) + delimiter;
+                    }
+                    log_println(msg, to_stdout, to_file, file);
+                }
+            }
+        }
+    };
+}   // namespace mperf
@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "linux-perf-events.h"
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+
+namespace mperf {
+    /// Get the online CPUs from /sys/devices/system/cpu/online.
+    inline std::vector<int> get_online_cpus() {
+        ProcFileReader reader("/sys/devices/system/cpu/online");
+        auto cpus = parse_id_list(reader.read());
+        if (cpus.empty()) {
+            throw (std::runtime_error("Cannot read the online CPUs from /sys/devices/system/cpu/online."));
+        }
+        return cpus;
+    }
+
+    /// Get /proc/sys/kernel/perf_event_paranoid, 2 (the usual default) if it cannot be read.
+    inline int get_perf_event_paranoid() {
+        std::ifstream file("/proc/sys/kernel/perf_event_paranoid", std::ios_base::in);
+        int paranoid = 2;
+        file >> paranoid;
+        return paranoid;
+    }
+
+    struct CpuTimes {
+        unsigned long long busy;
+        unsigned long long total;
+    };
+
+    /// Parse the "cpuN" lines of /proc/stat into the times of the given CPUs, in clock ticks.
+    /// Idle and iowait count as not busy.
+    inline void cpu_times(std::string_view text, const std::vector<int> &cpus, std::vector<CpuTimes> &times) {
+        times.assign(cpus.size(), {});
+        size_t line_start = 0;
+        while (line_start < text.size()) {
+            auto line_end = text.find('\n', line_start);
+            if (line_end == std::string_view::npos) {
+                line_end = text.size();
+            }
+            auto line = text.substr(line_start, line_end - line_start);
+            line_start = line_end + 1;
+            if (line.size() < 4 || line.substr(0, 3) != "cpu" || line[3] < '0' || line[3] > '9') {
+                continue;
+            }
+            size_t pos = 3;
+            auto cpu = static_cast<int>(parse_proc_number(line, pos));
+            size_t index = 0;
+            while (index < cpus.size() && cpus[index] != cpu) {
+                index += 1;
+            }
+            if (index == cpus.size()) {
+                continue;
+            }
+            // user nice system idle iowait irq softirq steal (guest time is included in user)
+            unsigned long long fields[8] = {};
+            for (auto &field: fields) {
+                field = parse_proc_number(line, pos);
+            }
+            auto idle = fields[3] + fields[4];
+            times[index].total = 0;
+            for (auto field: fields) {
+                times[index].total += field;
+            }
+            times[index].busy = times[index].total - idle;
+        }
+    }
+
+    /// Counts hardware events of all processes on every online CPU, to see noisy neighbours, per
+    /// core saturation and how the work is spread over the cores. One counter group is opened per
+    /// CPU (pid = -1, cpu = N) and read with a single read() per group at stop(). The results of
+    /// the start/stop intervals add up until reset().
+    ///
+    /// The groups are enabled and read one after another, so the window of each CPU is shifted by
+    /// the ioctl() or read() calls of the groups before it, a few us per CPU. If the kernel
+    /// multiplexed a group, e.g. because other users hold hardware counters, its counts are scaled
+    /// by the time enabled / time running and the CPU is flagged as multiplexed.
+    ///
+    /// System-wide counting needs perf_event_paranoid <= 0, CAP_PERFMON or root. The constructor
+    /// throws std::runtime_error if the counters cannot be opened.
+    template<typename TimeDurationType = std::chrono::milliseconds>
+    class SystemPerf {
+        std::vector<int> cpus;
+        std::vector<int> perf_attribute_metrics;
+        std::vector<std::unique_ptr<LinuxEvents<>>> groups;
+        std::vector<ull> group_result;
+        std::vector<std::vector<ull>> cpu_counts;
+        std::vector<char> cpu_multiplexed;
+        ProcFileReader stat_reader{"/proc/stat"};
+        std::vector<CpuTimes> times_start;
+        std::vector<CpuTimes> times_stop;
+        std::vector<CpuTimes> cpu_time_count;
+        ClockTimePointType start_time;
+        ClockDurationType time_count{};
+
+        /// IPC of a CPU, or of all CPUs with cpu_index == cpus.size(). 0 without cycles and instructions.
+        double ipc(size_t cpu_index) const;
+
+        /// Busy time / total time in %. /proc/stat counts in clock ticks (USER_HZ, usually 10 ms), so
+        /// this is coarse for intervals below a second and 0 for intervals shorter than a tick.
+        double utilization(size_t cpu_index) const;
+
+        ull count(size_t cpu_index, size_t metric_index) const;
+
+        /// 1 if the CPU was multiplexed, or the number of multiplexed CPUs with cpu_index == cpus.size().
+        size_t multiplexed_cpus(size_t cpu_index) const {
+            if (cpu_index < cpus.size()) {
+                return cpu_multiplexed[cpu_index];
+            }
+            return std::count(cpu_multiplexed.begin(), cpu_multiplexed.end(), true);
+        }
+
+        std::string cpu_name(size_t cpu_index) const {
+            return cpu_index == cpus.size() ? "Total" : "CPU " + std::to_string(cpus[cpu_index]);
+        }
+
+        public:
+        const std::string perf_name;
+
+        explicit SystemPerf(const std::vector<int> &perf_parameters = {PERF_COUNT_HW_CPU_CYCLES,
+                                                                       PERF_COUNT_HW_INSTRUCTIONS},
+                            std::string perf_name = "System Perf", bool exclude_kernel = false);
+
+        SystemPerf(const SystemPerf &) = delete;
+
+        void start();
+
+        void stop();
+
+        void reset();
+
+        const std::vector<int> &get_cpus() const {
+            return cpus;
+        }
+
+        /// Counts of the perf metrics per CPU, in the order of get_cpus().
+        const std::vector<std::vector<ull>> &get_cpu_counts() const {
+            return cpu_counts;
+        }
+
+        /// Whether the counts of a CPU were scaled because its group was multiplexed, in the order of get_cpus().
+        bool is_multiplexed(size_t cpu_index) const {
+            return cpu_multiplexed[cpu_index];
+        }
+
+        void report(const std::string &report_name = "Mini-Perf System Report", bool to_file = false,
+                    bool to_stdout = true, const std::string &file_path = "./mini_perf_system_report.log");
+
+        /// One row per CPU and a Total row.
+        void report_in_row(const std::string &report_name = "Mini-Perf System Report", bool to_file = false,
+                           bool to_stdout = true, const std::string &file_path = "./mini_perf_system_report.csv",
+                           const std::string &delimiter = ",");
+    };
+
+    // Implementations
+    template<typename TimeDurationType>
+    SystemPerf<TimeDurationType>::SystemPerf(const std::vector<int> &perf_parameters, std::string perf_name,
+                                             bool exclude_kernel)
+            : cpus(get_online_cpus()), perf_attribute_metrics(perf_parameters), perf_name(std::move(perf_name)) {
+        if (perf_attribute_metrics.empty()) {
+            throw (std::invalid_argument("SystemPerf needs at least one perf parameter."));
+        }
+        for (auto cpu: cpus) {
+            auto group = std::make_unique<LinuxEvents<>>(perf_attribute_metrics, exclude_kernel, -1, cpu);
+            if (!group->is_working()) {
+                auto error = group->get_error();
+                auto message = "Cannot open system-wide counters on CPU " + std::to_string(cpu) + ": " +
+                               std::string(strerror(error)) + ".";
+                auto paranoid = get_perf_event_paranoid();
+                if ((error == EACCES || error == EPERM) && paranoid > 0) {
+                    message += " perf_event_paranoid is " + std::to_string(paranoid) +
+                               ", system-wide counting needs 0 or less (sysctl kernel.perf_event_paranoid=0), "
+                               "CAP_PERFMON or root.";
+                }
+                throw (std::runtime_error(message));
+            }
+            groups.push_back(std::move(group));
+        }
+        group_result.resize(perf_attribute_metrics.size());
+        cpu_counts.assign(cpus.size(), std::vector<ull>(perf_attribute_metrics.size()));
+        cpu_multiplexed.assign(cpus.size(), false);
+        cpu_time_count.assign(cpus.size(), {});
+    }
+
+    template<typename TimeDurationType>
+    void SystemPerf<TimeDurationType>::start() {
+        cpu_times(stat_reader.read(), cpus, times_start);
+        start_time = ClockType::now();
+        for (auto &group: groups) {
+            group->start();
+        }
+    }
+
+    template<typename TimeDurationType>
+    void SystemPerf<TimeDurationType>::stop() {
+        for (size_t i = 0; i < groups.size(); ++i) {
+            groups[i]->end(group_result);
+            auto enabled = groups[i]->get_time_enabled();
+            auto running = groups[i]->get_time_running();
+            if (groups[i]->is_multiplexed()) {
+                cpu_multiplexed[i] = true;
+                for (auto &value: group_result) {
+                    value = running == 0 ? 0 : static_cast<ull>(static_cast<double>(value) * enabled / running + 0.5);
+                }
+            }
+            for (size_t j = 0; j < group_result.size(); ++j) {
+                cpu_counts[i][j] += group_result[j];
+            }
+        }
+        time_count += ClockType::now() - start_time;
+        cpu_times(stat_reader.read(), cpus, times_stop);
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            cpu_time_count[i].busy += times_stop[i].busy - times_start[i].busy;
+            cpu_time_count[i].total += times_stop[i].total - times_start[i].total;
+        }
+    }
+
+    template<typename TimeDurationType>
+    void SystemPerf<TimeDurationType>::reset() {
+        for (auto &counts: cpu_counts) {
+            std::fill(counts.begin(), counts.end(), 0);
+        }
+        std::fill(cpu_multiplexed.begin(), cpu_multiplexed.end(), false);
+        std::fill(cpu_time_count.begin(), cpu_time_count.end(), CpuTimes{});
+        time_count = ClockDurationType::zero();
+    }
+
+    template<typename TimeDurationType>
+    ull SystemPerf<TimeDurationType>::count(size_t cpu_index, size_t metric_index) const {
+        if (cpu_index < cpus.size()) {
+            return cpu_counts[cpu_index][metric_index];
+        }
+        ull total = 0;
+        for (auto &counts: cpu_counts) {
+            total += counts[metric_index];
+        }
+        return total;
+    }
+
+    template<typename TimeDurationType>
+    double SystemPerf<TimeDurationType>::ipc(size_t cpu_index) const {
+        auto cycles = std::find(perf_attribute_metrics.begin(), perf_attribute_metrics.end(), PERF_COUNT_HW_CPU_CYCLES);
+        auto instructions = std::find(perf_attribute_metrics.begin(), perf_attribute_metrics.end(),
+                                      PERF_COUNT_HW_INSTRUCTIONS);
+        if (cycles == perf_attribute_metrics.end() || instructions == perf_attribute_metrics.end()) {
+            return 0;
+        }
+        auto cycle_count = count(cpu_index, cycles - perf_attribute_metrics.begin());
+        auto instruction_count = count(cpu_index, instructions - perf_attribute_metrics.begin());
+        return cycle_count == 0 ? 0 : static_cast<double>(instruction_count) / static_cast<double>(cycle_count);
+    }
+
+    template<typename TimeDurationType>
+    double SystemPerf<TimeDurationType>::utilization(size_t cpu_index) const {
+        ull busy = 0, total = 0;
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            if (cpu_index == cpus.size() || cpu_index == i) {
+                busy += cpu_time_count[i].busy;
+                total += cpu_time_count[i].total;
+            }
+        }
+        return total == 0 ? 0 : static_cast<double>(busy) * 100 / static_cast<double>(total);
+    }
+
+    template<typename TimeDurationType>
+    void SystemPerf<TimeDurationType>::report(const std::string &report_name, bool to_file, bool to_stdout,
+                                              const std::string &file_path) {
+        std::ofstream file;
+        if (to_file) {
+            file = std::ofstream(file_path, std::ios::app);
+            // print absolute path
+            auto abs_path_msg = "Log File Path: " + std::filesystem::absolute(file_path).string();
+            log_println(abs_path_msg, true, false, file);
+        }
+        log_println("Name: " + perf_name, to_stdout, to_file, file);
+        log_println("Report Name: " + report_name, to_stdout, to_file, file);
+        log_println("Report Time: " + get_time(), to_stdout, to_file, file);
+        auto duration = std::chrono::duration_cast<TimeDurationType>(time_count).count();
+        log_println(get_mini_metric_name(MINI_TIME_COUNT) + ": " + std::to_string(duration) +
+                    get_time_unit<TimeDurationType>(), to_stdout, to_file, file);
+        // The CPUs, then the total
+        for (size_t i = 0; i <= cpus.size(); ++i) {
+            auto name = cpu_name(i);
+            for (size_t j = 0; j < perf_attribute_metrics.size(); ++j) {
+                auto msg = name + " " + get_perf_metric_name(perf_attribute_metrics[j]) + ": " +
+                           std::to_string(count(i, j));
+                log_println(msg, to_stdout, to_file, file);
+            }
+            log_println(name + " IPC: " + std::to_string(ipc(i)), to_stdout, to_file, file);
+            log_println(name + " " + get_mini_metric_name(MINI_CPU_UTILIZATION) + ": " + std::to_string(utilization(i)) +
+                        get_mini_metric_unit(MINI_CPU_UTILIZATION), to_stdout, to_file, file);
+            log_println(name + " Multiplexed: " + std::to_string(multiplexed_cpus(i)), to_stdout, to_file, file);
+        }
+
+        if (to_file) {
+            file.close();
+        }
+    }
+
+    template<typename TimeDurationType>
+    void SystemPerf<TimeDurationType>::report_in_row(const std::string &report_name, bool to_file, bool to_stdout,
+                                                     const std::string &file_path, const std::string &delimiter) {
+        std::ofstream file;
+        if (to_file) {
+            file = std::ofstream(file_path, std::ios::app);
+            // print absolute path
+            auto abs_path_msg = "Log File Path: " + std::filesystem::absolute(file_path).string();
+            log_println(abs_path_msg, true, false, file);
+        }
+
+        // Print header if the file is empty
+        if (file.tellp() == 0) {
+            std::string header = "Name" + delimiter + "Report Name" + delimiter + "Report Time" + delimiter + "CPU" +
+                                 delimiter + get_mini_metric_name(MINI_TIME_COUNT) + "(" +
+                                 get_time_unit<TimeDurationType>() + ")" + delimiter;
+            for (auto metric: perf_attribute_metrics) {
+                header += get_perf_metric_name(metric) + delimiter;
+            }
+            header += "IPC" + delimiter + get_mini_metric_name(MINI_CPU_UTILIZATION) + "(" +
+                      get_mini_metric_unit(MINI_CPU_UTILIZATION) + ")" + delimiter + "Multiplexed" + delimiter;
+            log_println(header, to_stdout, to_file, file);
+        }
+
+        auto report_time = get_time();
+        auto duration = std::chrono::duration_cast<TimeDurationType>(time_count).count();
+        for (size_t i = 0; i <= cpus.size(); ++i) {
+            auto msg = perf_name + delimiter + report_name + delimiter + report_time + delimiter +
+                       (i == cpus.size() ? std::string("Total") : std::to_string(cpus[i])) + delimiter +
+                       std::to_string(duration) + delimiter;
+            for (size_t j = 0; j < perf_attribute_metrics.size(); ++j) {
+                msg += std::to_string(count(i, j)) + delimiter;
+            }
+            msg += std::to_string(ipc(i)) + delimiter + std::to_string(utilization(i)) + delimiter +
+                   std::to_string(multiplexed_cpus(i)) + delimiter;
+            log_println(msg, to_stdout, to_file, file);
+        }
+
+        if (to_file) {
+            file.close();
+        }
+    }
+}   // namespace mperf
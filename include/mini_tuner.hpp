@@ -0,0 +1,451 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+
+namespace mperf {
+    enum TuneStrategy {
+        MINI_TUNE_GRID = 0,                 // Measure every configuration.
+        MINI_TUNE_RANDOM = 1,               // Measure a random subset of the configurations.
+        MINI_TUNE_SUCCESSIVE_HALVING = 2,   // Measure all, keep the better half, double the samples.
+    };
+
+    inline std::string get_tune_strategy_name(int strategy) {
+        if (strategy == MINI_TUNE_GRID) {
+            return "Grid";
+        } else if (strategy == MINI_TUNE_RANDOM) {
+            return "Random";
+        } else if (strategy == MINI_TUNE_SUCCESSIVE_HALVING) {
+            return "Successive Halving";
+        } else {
+            return "Unknown";
+        }
+    }
+
+    /// Values of the parameters of one configuration. Enum parameters hold the index of the label.
+    using TuneConfig = std::map<std::string, long long>;
+
+    /// A dimension of the search space: an integer range or an enum.
+    struct TuneParameter {
+        std::string name;
+        std::vector<long long> values;
+        std::vector<std::string> labels;    // Enum labels, empty for integers
+
+        /// min, min + step, ... up to max.
+        static TuneParameter range(std::string name, long long min, long long max, long long step = 1) {
+            if (step <= 0 || min > max) {
+                throw (std::invalid_argument("Invalid range of " + name));
+            }
+            TuneParameter parameter{std::move(name), {}, {}};
+            for (auto value = min; value <= max; value += step) {
+                parameter.values.push_back(value);
+            }
+            return parameter;
+        }
+
+        /// The powers of two from min to max, e.g. block sizes.
+        static TuneParameter powers_of_two(std::string name, long long min, long long max) {
+            if (min <= 0 || min > max) {
+                throw (std::invalid_argument("Invalid range of " + name));
+            }
+            TuneParameter parameter{std::move(name), {}, {}};
+            for (auto value = min; value <= max; value *= 2) {
+                parameter.values.push_back(value);
+            }
+            return parameter;
+        }
+
+        static TuneParameter enumeration(std::string name, std::vector<std::string> labels) {
+            if (labels.empty()) {
+                throw (std::invalid_argument("No labels for " + name));
+            }
+            TuneParameter parameter{std::move(name), {}, {}};
+            parameter.values.resize(labels.size());
+            std::iota(parameter.values.begin(), parameter.values.end(), 0);
+            parameter.labels = std::move(labels);
+            return parameter;
+        }
+
+        std::string format(long long value) const {
+            return labels.empty() ? std::to_string(value) : labels.at(value);
+        }
+    };
+
+    /// The value to minimize, computed from the metrics of one measured run of the body.
+    struct TuneObjective {
+        std::string name;
+        std::function<double(const std::vector<std::pair<std::string, double>> &)> evaluate;
+        bool maximize = false;
+
+        /// The running time in ns.
+        static TuneObjective time() {
+            return metric(get_mini_metric_name(MINI_TIME_COUNT) + "(ns)");
+        }
+
+        /// A metric of get_last_metrics(), e.g. "Cache Misses" or "Syscalls".
+        static TuneObjective metric(const std::string &metric_name, bool maximize = false) {
+            return {metric_name, [metric_name](const std::vector<std::pair<std::string, double>> &metrics) {
+                for (auto &[name, value]: metrics) {
+                    if (name == metric_name) {
+                        return value;
+                    }
+                }
+                throw (std::invalid_argument("Objective metric is not measured: " + metric_name));
+            }, maximize};
+        }
+
+        /// A derived metric, e.g. instructions per byte.
+        static TuneObjective custom(std::string name,
+                                    std::function<double(const std::vector<std::pair<std::string, double>> &)> evaluate,
+                                    bool maximize = false) {
+            return {std::move(name), std::move(evaluate), maximize};
+        }
+    };
+
+    /// Mean of the objective of a configuration with its 95% confidence interval.
+    struct TuneMeasurement {
+        TuneConfig config;
+        double mean{};
+        double ci_low{};
+        double ci_high{};
+        size_t samples{};
+    };
+
+    struct TuneResult {
+        TuneMeasurement best;
+        std::vector<TuneMeasurement> explored;  // Empty when loaded from the cache
+        bool cached{};                          // best was loaded from the cache, nothing was measured
+    };
+
+    /// Searches the configuration of a parameterized benchmark body that minimizes (or maximizes)
+    /// an objective measured with MiniPerf. Every sample is one run of the body between start()
+    /// and stop(), after one warm-up run per configuration. The best configuration is cached in a
+    /// file, keyed by the CPU model, the tuner name, the search space and the objective, so that
+    /// a rerun on the same machine returns it without measuring. The key also holds the strategy,
+    /// the samples and the budget.
+    class AutoTuner {
+        std::string name;
+        std::vector<TuneParameter> parameters;
+        std::vector<int> mini_metrics;
+        std::vector<int> perf_metrics;
+        TuneObjective objective = TuneObjective::time();
+        TuneStrategy strategy = MINI_TUNE_GRID;
+        size_t budget = 0;
+        size_t samples = 10;
+        std::string cache_path = "./mini_perf_tuner.cache";
+        unsigned int seed = std::random_device{}();
+
+        std::vector<TuneConfig> all_configs() const;
+
+        std::string cache_key() const;
+
+        bool load_cached(TuneMeasurement &measurement) const;
+
+        void save_cached(const TuneMeasurement &measurement) const;
+
+        template<typename Body>
+        TuneMeasurement measure(MiniPerf<std::chrono::nanoseconds> &perf, Body &body, const TuneConfig &config,
+                                size_t sample_count) const;
+
+        bool better(const TuneMeasurement &a, const TuneMeasurement &b) const {
+            return objective.maximize ? a.mean > b.mean : a.mean < b.mean;
+        }
+
+        /// The confidence intervals do not overlap and a is on the worse side.
+        bool clearly_worse(const TuneMeasurement &a, const TuneMeasurement &b) const {
+            return objective.maximize ? a.ci_high < b.ci_low : a.ci_low > b.ci_high;
+        }
+
+        public:
+        /// MINI_TIME_COUNT is always measured, add the metrics the objective needs.
+        explicit AutoTuner(std::string name, std::vector<TuneParameter> parameters,
+                           std::vector<int> mini_metrics = {MINI_TIME_COUNT}, std::vector<int> perf_metrics = {});
+
+        void set_objective(TuneObjective tune_objective) {
+            objective = std::move(tune_objective);
+        }
+
+        /// budget is the number of configurations of a random search and the number of
+        /// configurations sampled before successive halving, 0 for all of them.
+        void set_strategy(TuneStrategy tune_strategy, size_t tune_budget = 0) {
+            strategy = tune_strategy;
+            budget = tune_budget;
+        }
+
+        /// Samples per configuration, and of the first round of successive halving.
+        void set_samples(size_t sample_count) {
+            if (sample_count < 2) {
+                throw (std::invalid_argument("At least 2 samples are needed for a confidence interval."));
+            }
+            samples = sample_count;
+        }
+
+        /// An empty path disables the cache.
+        void set_cache(const std::string &file_path) {
+            cache_path = file_path;
+        }
+
+        void set_seed(unsigned int random_seed) {
+            seed = random_seed;
+        }
+
+        /// Run the search. body(const TuneConfig &) runs the measured work once. On a cache hit
+        /// only best is set, explored is empty and cached is true.
+        template<typename Body>
+        TuneResult tune(Body body);
+
+        /// Format a configuration like "block=64, order=Column".
+        std::string format(const TuneConfig &config) const;
+
+        void report(const TuneResult &result, bool to_file = false, bool to_stdout = true,
+                    const std::string &file_path = "./mini_perf_tuner.log") const;
+    };
+
+    namespace tuner_detail {
+        /// Two-sided 95% Student's t quantile for the degrees of freedom.
+        inline double t_quantile_95(size_t degrees) {
+            static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                           2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                           2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+            if (degrees == 0) {
+                return 0;
+            }
+            return degrees <= 30 ? table[degrees - 1] : 1.96;
+        }
+    }   // namespace tuner_detail
+
+    // Implementations
+    inline AutoTuner::AutoTuner(std::string name, std::vector<TuneParameter> parameters, std::vector<int> mini_metrics,
+                                std::vector<int> perf_metrics)
+            : name(std::move(name)), parameters(std::move(parameters)), mini_metrics(std::move(mini_metrics)),
+              perf_metrics(std::move(perf_metrics)) {
+        if (this->parameters.empty()) {
+            throw (std::invalid_argument("The search space of " + this->name + " is empty."));
+        }
+        if (std::find(this->mini_metrics.begin(), this->mini_metrics.end(), MINI_TIME_COUNT) == this->mini_metrics.end()) {
+            this->mini_metrics.insert(this->mini_metrics.begin(), MINI_TIME_COUNT);
+        }
+    }
+
+    inline std::vector<TuneConfig> AutoTuner::all_configs() const {
+        std::vector<TuneConfig> configs(1);
+        for (auto &parameter: parameters) {
+            std::vector<TuneConfig> expanded;
+            for (auto &config: configs) {
+                for (auto value: parameter.values) {
+                    auto next = config;
+                    next[parameter.name] = value;
+                    expanded.push_back(std::move(next));
+                }
+            }
+            configs = std::move(expanded);
+        }
+        return configs;
+    }
+
+    template<typename Body>
+    TuneMeasurement AutoTuner::measure(MiniPerf<std::chrono::nanoseconds> &perf, Body &body, const TuneConfig &config,
+                                       size_t sample_count) const {
+        body(config);
+        std::vector<double> values;
+        for (size_t i = 0; i < sample_count; ++i) {
+            perf.start();
+            body(config);
+            perf.stop();
+            values.push_back(objective.evaluate(perf.get_last_metrics()));
+        }
+        perf.reset();
+
+        TuneMeasurement measurement{config};
+        measurement.samples = values.size();
+        measurement.mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        double squares = 0;
+        for (auto value: values) {
+            squares += (value - measurement.mean) * (value - measurement.mean);
+        }
+        auto stddev = values.size() > 1 ? std::sqrt(squares / (values.size() - 1)) : 0;
+        auto half_width = tuner_detail::t_quantile_95(values.size() - 1) * stddev / std::sqrt(values.size());
+        measurement.ci_low = measurement.mean - half_width;
+        measurement.ci_high = measurement.mean + half_width;
+        return measurement;
+    }
+
+    template<typename Body>
+    TuneResult AutoTuner::tune(Body body) {
+        TuneResult result;
+        if (load_cached(result.best)) {
+            result.cached = true;
+            return result;
+        }
+
+        auto configs = all_configs();
+        std::mt19937 generator(seed);
+        if ((strategy == MINI_TUNE_RANDOM || strategy == MINI_TUNE_SUCCESSIVE_HALVING) &&
+            budget > 0 && budget < configs.size()) {
+            std::shuffle(configs.begin(), configs.end(), generator);
+            configs.resize(budget);
+        }
+
+        MiniPerf<std::chrono::nanoseconds> perf(mini_metrics, perf_metrics, name);
+        auto by_objective = [this](const TuneMeasurement &a, const TuneMeasurement &b) { return better(a, b); };
+        if (strategy == MINI_TUNE_SUCCESSIVE_HALVING) {
+            // Every round keeps the better half by mean, and drops more of it when their confidence
+            // interval is entirely worse than that of the best. The survivors get twice the samples,
+            // so a round costs at most the first and there are at most ceil(log2(n)) rounds.
+            size_t round_samples = samples;
+            while (true) {
+                std::vector<TuneMeasurement> round;
+                for (auto &config: configs) {
+                    round.push_back(measure(perf, body, config, round_samples));
+                }
+                result.explored.insert(result.explored.end(), round.begin(), round.end());
+                std::stable_sort(round.begin(), round.end(), by_objective);
+                configs.clear();
+                for (size_t i = 0; i < (round.size() + 1) / 2; ++i) {
+                    if (i == 0 || !clearly_worse(round[i], round.front())) {
+                        configs.push_back(round[i].config);
+                    }
+                }
+                if (configs.size() == 1) {
+                    result.best = round.front();
+                    break;
+                }
+                round_samples *= 2;
+            }
+        } else {
+            for (auto &config: configs) {
+                result.explored.push_back(measure(perf, body, config, samples));
+            }
+            result.best = *std::min_element(result.explored.begin(), result.explored.end(), by_objective);
+        }
+
+        save_cached(result.best);
+        return result;
+    }
+
+    // The key changes whenever anything that affects the best configuration changes.
+    inline std::string AutoTuner::cache_key() const {
+        std::string key = get_cpu_model() + "\t" + name + "\t" + objective.name + (objective.maximize ? " max" : " min") +
+                          "\t" + get_tune_strategy_name(strategy) + " " + std::to_string(samples) + " " +
+                          std::to_string(budget) + "\t";
+        for (auto &parameter: parameters) {
+            key += parameter.name + ":";
+            for (auto value: parameter.values) {
+                key += parameter.format(value) + ",";
+            }
+            key += ";";
+        }
+        return key;
+    }
+
+    // Cache line: CPU model, tuner name, objective, strategy with samples and budget, search space,
+    // then the configuration as name=value pairs, mean, confidence interval and samples, separated
+    // by tabs.
+    inline bool AutoTuner::load_cached(TuneMeasurement &measurement) const {
+        if (cache_path.empty()) {
+            return false;
+        }
+        auto key = cache_key();
+        std::ifstream file(cache_path, std::ios_base::in);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.rfind(key + "\t", 0) != 0) {
+                continue;
+            }
+            std::istringstream fields(line.substr(key.size() + 1));
+            std::string config_field;
+            if (!std::getline(fields, config_field, '\t') ||
+                !(fields >> measurement.mean >> measurement.ci_low >> measurement.ci_high >> measurement.samples)) {
+                return false;
+            }
+            measurement.config.clear();
+            std::istringstream pairs(config_field);
+            std::string pair;
+            while (std::getline(pairs, pair, ',')) {
+                auto pos = pair.find('=');
+                if (pos != std::string::npos) {
+                    measurement.config[pair.substr(0, pos)] = std::stoll(pair.substr(pos + 1));
+                }
+            }
+            return measurement.config.size() == parameters.size();
+        }
+        return false;
+    }
+
+    inline void AutoTuner::save_cached(const TuneMeasurement &measurement) const {
+        if (cache_path.empty()) {
+            return;
+        }
+        auto key = cache_key();
+        std::vector<std::string> lines;
+        {
+            std::ifstream file(cache_path, std::ios_base::in);
+            std::string line;
+            while (std::getline(file, line)) {
+                if (line.rfind(key + "\t", 0) != 0) {
+                    lines.push_back(line);
+                }
+            }
+        }
+        std::ostringstream entry;
+        entry.precision(17);
+        entry << key << "\t";
+        for (auto it = measurement.config.begin(); it != measurement.config.end(); ++it) {
+            entry << (it == measurement.config.begin() ? "" : ",") << it->first << "=" << it->second;
+        }
+        entry << "\t" << measurement.mean << " " << measurement.ci_low << " " << measurement.ci_high << " "
+              << measurement.samples;
+        lines.push_back(entry.str());
+        std::ofstream file(cache_path, std::ios::trunc);
+        for (auto &line: lines) {
+            file << line << "\n";
+        }
+    }
+
+    inline std::string AutoTuner::format(const TuneConfig &config) const {
+        std::string text;
+        for (auto &parameter: parameters) {
+            auto it = config.find(parameter.name);
+            if (it != config.end()) {
+                text += (text.empty() ? "" : ", ") + parameter.name + "=" + parameter.format(it->second);
+            }
+        }
+        return text;
+    }
+
+    inline void AutoTuner::report(const TuneResult &result, bool to_file, bool to_stdout,
+                                  const std::string &file_path) const {
+        std::ofstream file;
+        if (to_file) {
+            file = std::ofstream(file_path, std::ios::app);
+        }
+        auto line = [&](const TuneMeasurement &measurement) {
+            return format(measurement.config) + ": " + std::to_string(measurement.mean) + " [" +
+                   std::to_string(measurement.ci_low) + ", " + std::to_string(measurement.ci_high) + "] (" +
+                   std::to_string(measurement.samples) + " samples)";
+        };
+        log_println("Tuner: " + name, to_stdout, to_file, file);
+        log_println("Report Time: " + get_time(), to_stdout, to_file, file);
+        log_println("Objective: " + objective.name + (objective.maximize ? " (maximize)" : " (minimize)"),
+                    to_stdout, to_file, file);
+        log_println("Strategy: " + get_tune_strategy_name(strategy), to_stdout, to_file, file);
+        for (auto &measurement: result.explored) {
+            log_println("Explored " + line(measurement), to_stdout, to_file, file);
+        }
+        log_println(std::string(result.cached ? "Cached " : "Best ") + line(result.best), to_stdout, to_file, file);
+    }
+}   // namespace mperf
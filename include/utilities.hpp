@@ -2,15 +2,22 @@
 
 #include <iostream>
 #include <chrono>
+#include <ctime>
 #include <tuple>
 #include <type_traits>
 #include <linux/perf_event.h>
 #include <string_view>
 #include <fstream>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
 
 namespace mperf {
-    const size_t MINI_ATTRIBUTE_MAX = 6;    // Do not forget to change this when adding new mini attributes.
+    const size_t MINI_ATTRIBUTE_MAX = 29;    // Do not forget to change this when adding new mini attributes.
     enum MiniFlag {
         MINI_TIME_COUNT = 0,
         MINI_MEMORY_COUNT = 1,  // Allocated physical mem. between start and stop.
@@ -19,8 +26,56 @@ namespace mperf {
         MINI_BRANCH_MISS_RATE = 4,
         MINI_AVERAGE_IPC = 5,
         MINI_CPU_UTILIZATION = 6,
+        MINI_VOLUNTARY_SWITCHES = 7,    // Context switches of the thread while waiting for a resource.
+        MINI_INVOLUNTARY_SWITCHES = 8,  // Context switches of the thread by preemption.
+        MINI_ON_CPU_TIME = 9,           // Time the thread spent running on a CPU.
+        MINI_RUN_QUEUE_TIME = 10,       // Time the thread was runnable but waiting on a run queue.
+        MINI_BLOCKED_TIME = 11,         // Wall time minus on CPU and run queue time.
+        MINI_MINOR_FAULTS = 12,
+        MINI_MAJOR_FAULTS = 13,
+        MINI_CPU_MIGRATIONS = 14,
+        MINI_ENERGY_PACKAGE = 15,       // RAPL energy of the CPU packages, reported in J and W.
+        MINI_ENERGY_DRAM = 16,          // RAPL energy of the DRAM, reported in J and W.
+        MINI_NUMA_PAGES = 17,           // Resident pages per NUMA node when stopped, of the process or a tracked buffer.
+                                        // A snapshot, not a delta, and parsing numa_maps costs ~100 us per stop().
+        MINI_ANON_HUGE_PAGES = 18,      // Transparent huge pages of the process when stopped.
+        MINI_NUMA_HIT = 19,             // System-wide pages allocated on the intended node.
+        MINI_NUMA_MISS = 20,            // System-wide pages allocated on another node than intended.
+        MINI_CURRENT_CPU = 21,          // CPU of the measuring thread when stopped.
+        MINI_CURRENT_NODE = 22,         // NUMA node of the measuring thread when stopped.
+        MINI_READ_CHARS = 23,           // Bytes the thread read through syscalls, including the page cache.
+        MINI_WRITE_CHARS = 24,          // Bytes the thread wrote through syscalls, including the page cache.
+        MINI_READ_SYSCALLS = 25,        // read-like syscalls of the thread.
+        MINI_WRITE_SYSCALLS = 26,       // write-like syscalls of the thread.
+        MINI_STORAGE_READ_BYTES = 27,   // Bytes the thread caused to be read from storage.
+        MINI_STORAGE_WRITE_BYTES = 28,  // Bytes the thread caused to be written to storage.
+        MINI_SYSCALLS = 29,             // All syscalls of the thread, from the raw_syscalls:sys_enter tracepoint.
     };
 
+    inline bool is_scheduler_metric(int metric) {
+        return metric >= MINI_VOLUNTARY_SWITCHES && metric <= MINI_CPU_MIGRATIONS;
+    }
+
+    /// Energy metrics are counted in uJ and reported in J, together with the average power.
+    inline bool is_energy_metric(int metric) {
+        return metric == MINI_ENERGY_PACKAGE || metric == MINI_ENERGY_DRAM;
+    }
+
+    /// Metrics from /proc/thread-self/io.
+    inline bool is_io_metric(int metric) {
+        return metric >= MINI_READ_CHARS && metric <= MINI_STORAGE_WRITE_BYTES;
+    }
+
+    inline bool is_numa_metric(int metric) {
+        return metric >= MINI_NUMA_PAGES && metric <= MINI_CURRENT_NODE;
+    }
+
+    /// Metrics that add up over the start/stop intervals, the others describe the last interval.
+    inline bool is_cumulative_metric(int metric) {
+        return metric == MINI_MEMORY_COUNT || is_scheduler_metric(metric) || is_energy_metric(metric) ||
+               metric == MINI_NUMA_HIT || metric == MINI_NUMA_MISS || is_io_metric(metric) || metric == MINI_SYSCALLS;
+    }
+
     std::string get_time() {
         time_t now = time(0);
         tm *ltm = localtime(&now);
@@ -73,6 +128,55 @@ namespace mperf {
         }
     }
 
+    /// Get the last line of a CSV file that starts with first_column, i.e. the header the next row is appended
+    /// under. Empty if there is none. Only the tail of the file is read, growing until a header is found.
+    inline std::string last_csv_header(const std::string &file_path, const std::string &first_column) {
+        std::ifstream file(file_path, std::ios_base::in | std::ios_base::binary);
+        file.seekg(0, std::ios_base::end);
+        std::streamoff size = file.tellg();
+        std::streamoff tail = 64 * 1024;
+        while (size > 0) {
+            std::streamoff begin = std::max<std::streamoff>(size - tail, 0);
+            std::string text(size - begin, '\0');
+            file.seekg(begin);
+            file.read(text.data(), static_cast<std::streamsize>(text.size()));
+            // Search the lines from the back. The first line of the tail may be cut unless it starts the file.
+            size_t line_end = text.size();
+            while (line_end > 0) {
+                size_t line_begin = text.rfind('\n', line_end - 1);
+                line_begin = line_begin == std::string::npos ? 0 : line_begin + 1;
+                if (line_begin == 0 && begin > 0) {
+                    break;
+                }
+                std::string_view line(text.data() + line_begin, line_end - line_begin);
+                if (line.substr(0, first_column.size()) == first_column) {
+                    return std::string(line);
+                }
+                if (line_begin == 0) {
+                    break;
+                }
+                line_end = line_begin - 1;
+            }
+            if (begin == 0) {
+                break;
+            }
+            tail *= 2;
+        }
+        return "";
+    }
+
+    /// Header and size of a CSV file after this process last appended a row to it. While nobody else appends
+    /// to the file, the next row can be checked against the header without reading the file again.
+    struct CsvHeaderState {
+        std::streamoff end = -1;
+        std::string header;
+    };
+
+    inline std::unordered_map<std::string, CsvHeaderState> &csv_header_states() {
+        static std::unordered_map<std::string, CsvHeaderState> states;
+        return states;
+    }
+
     std::string get_mini_metric_unit(int metric) {
         if (metric == MINI_TIME_COUNT) {
             std::cerr << "Use get_time_unit() instead." << std::endl;
@@ -87,6 +191,15 @@ namespace mperf {
             return "%";
         } else if (metric == MINI_CPU_UTILIZATION) {
             return "%";
+        } else if (metric == MINI_ON_CPU_TIME || metric == MINI_RUN_QUEUE_TIME || metric == MINI_BLOCKED_TIME) {
+            return "ns";
+        } else if (is_energy_metric(metric)) {
+            return "J";
+        } else if (metric == MINI_ANON_HUGE_PAGES) {
+            return "KB";
+        } else if (metric == MINI_READ_CHARS || metric == MINI_WRITE_CHARS || metric == MINI_STORAGE_READ_BYTES ||
+                   metric == MINI_STORAGE_WRITE_BYTES) {
+            return "B";
         } else {
             return "";
         }
@@ -107,6 +220,52 @@ namespace mperf {
             return "Average IPC";
         } else if (metric == MINI_CPU_UTILIZATION) {
             return "CPU Utilization";
+        } else if (metric == MINI_VOLUNTARY_SWITCHES) {
+            return "Voluntary Switches";
+        } else if (metric == MINI_INVOLUNTARY_SWITCHES) {
+            return "Involuntary Switches";
+        } else if (metric == MINI_ON_CPU_TIME) {
+            return "On CPU Time";
+        } else if (metric == MINI_RUN_QUEUE_TIME) {
+            return "Run Queue Time";
+        } else if (metric == MINI_BLOCKED_TIME) {
+            return "Blocked Time";
+        } else if (metric == MINI_MINOR_FAULTS) {
+            return "Minor Faults";
+        } else if (metric == MINI_MAJOR_FAULTS) {
+            return "Major Faults";
+        } else if (metric == MINI_CPU_MIGRATIONS) {
+            return "CPU Migrations";
+        } else if (metric == MINI_ENERGY_PACKAGE) {
+            return "Package Energy";
+        } else if (metric == MINI_ENERGY_DRAM) {
+            return "DRAM Energy";
+        } else if (metric == MINI_NUMA_PAGES) {
+            return "NUMA Pages";
+        } else if (metric == MINI_ANON_HUGE_PAGES) {
+            return "Anon Huge Pages";
+        } else if (metric == MINI_NUMA_HIT) {
+            return "NUMA Hit";
+        } else if (metric == MINI_NUMA_MISS) {
+            return "NUMA Miss";
+        } else if (metric == MINI_CURRENT_CPU) {
+            return "Current CPU";
+        } else if (metric == MINI_CURRENT_NODE) {
+            return "Current Node";
+        } else if (metric == MINI_READ_CHARS) {
+            return "Read Chars";
+        } else if (metric == MINI_WRITE_CHARS) {
+            return "Write Chars";
+        } else if (metric == MINI_READ_SYSCALLS) {
+            return "Read Syscalls";
+        } else if (metric == MINI_WRITE_SYSCALLS) {
+            return "Write Syscalls";
+        } else if (metric == MINI_STORAGE_READ_BYTES) {
+            return "Storage Read Bytes";
+        } else if (metric == MINI_STORAGE_WRITE_BYTES) {
+            return "Storage Write Bytes";
+        } else if (metric == MINI_SYSCALLS) {
+            return "Syscalls";
         } else {
             return "Unknown";
         }
@@ -245,4 +404,244 @@ namespace mperf {
         }
     }
 
+    /// Reads a /proc or /sys file through a file descriptor that stays open between reads, which
+    /// saves the path lookup and open/close on every sample. The file is opened on first use.
+    class ProcFileReader {
+        std::string path;
+        int fd = -1;
+        std::string buffer;
+        size_t read_calls = 0;
+
+        public:
+        explicit ProcFileReader(std::string path) : path(std::move(path)) {}
+
+        ProcFileReader(const ProcFileReader &) = delete;
+
+        ProcFileReader &operator=(const ProcFileReader &) = delete;
+
+        ~ProcFileReader() {
+            close_file();
+        }
+
+        /// Close the file so that the next read opens it again. /proc/thread-self is resolved
+        /// when the file is opened, so this is needed after moving to another thread or process.
+        void close_file() {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        /// Read the whole file. Returns an empty view if the file cannot be read.
+        std::string_view read() {
+            if (fd == -1) {
+                fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1) {
+                    return {};
+                }
+            }
+            if (buffer.empty()) {
+                buffer.resize(4096);
+            }
+            size_t size = 0;
+            read_calls = 0;
+            while (true) {
+                ssize_t bytes = pread(fd, buffer.data() + size, buffer.size() - size, size);
+                read_calls += 1;
+                if (bytes <= 0) {
+                    break;
+                }
+                size += bytes;
+                if (size == buffer.size()) {
+                    buffer.resize(buffer.size() * 2);
+                }
+            }
+            return {buffer.data(), size};
+        }
+
+        /// Number of pread calls made by the last read().
+        size_t get_read_calls() const {
+            return read_calls;
+        }
+    };
+
+    /// Parse the number at pos in a /proc style text, skipping leading separators, and move pos past it.
+    inline unsigned long long parse_proc_number(std::string_view text, size_t &pos) {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == ':' || text[pos] == '\t')) {
+            pos += 1;
+        }
+        unsigned long long value = 0;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+            value = value * 10 + (text[pos] - '0');
+            pos += 1;
+        }
+        return value;
+    }
+
+    /// Get the number after "key" at the start of a line in a /proc style text, 0 if absent.
+    inline unsigned long long find_proc_value(std::string_view text, std::string_view key) {
+        size_t pos = 0;
+        while ((pos = text.find(key, pos)) != std::string_view::npos) {
+            if (pos == 0 || text[pos - 1] == '\n') {
+                pos += key.size();
+                return parse_proc_number(text, pos);
+            }
+            pos += key.size();
+        }
+        return 0;
+    }
+
+    struct SchedulerStats {
+        unsigned long long wall_time_ns;
+        unsigned long long on_cpu_ns;
+        unsigned long long run_queue_ns;
+        unsigned long long voluntary_switches;
+        unsigned long long involuntary_switches;
+        unsigned long long minor_faults;
+        unsigned long long major_faults;
+        unsigned long long cpu_migrations;
+    };
+
+    /// Sample the scheduler counters of the calling thread. schedstat_reader reads
+    /// /proc/thread-self/schedstat, sched_reader reads /proc/thread-self/sched and is only
+    /// needed for CPU migrations, which are 0 if the kernel has no CONFIG_SCHED_DEBUG.
+    /// The times are sampled separately by thread_scheduler_clocks().
+    inline void thread_scheduler_stats(SchedulerStats &stats, ProcFileReader &schedstat_reader,
+                                       ProcFileReader *sched_reader = nullptr) {
+        // schedstat: time on CPU (ns), time waiting on a run queue (ns), number of time slices.
+        // The run queue time is added when the thread is switched in, so it is exact at any time.
+        auto schedstat = schedstat_reader.read();
+        size_t pos = 0;
+        parse_proc_number(schedstat, pos);
+        stats.run_queue_ns = parse_proc_number(schedstat, pos);
+
+        rusage usage{};
+        getrusage(RUSAGE_THREAD, &usage);
+        stats.voluntary_switches = usage.ru_nvcsw;
+        stats.involuntary_switches = usage.ru_nivcsw;
+        stats.minor_faults = usage.ru_minflt;
+        stats.major_faults = usage.ru_majflt;
+
+        stats.cpu_migrations = sched_reader != nullptr ? find_proc_value(sched_reader->read(), "se.nr_migrations") : 0;
+    }
+
+    /// Sample the wall time and the CPU time of the calling thread. The time on CPU of schedstat is
+    /// only updated at ticks and context switches, CLOCK_THREAD_CPUTIME_ID includes the running
+    /// time slice. The start sample takes the wall time first and the stop sample last, so that the
+    /// CPU time of an interval never exceeds its wall time.
+    inline void thread_scheduler_clocks(SchedulerStats &stats, bool start_sample) {
+        auto wall_time = [] {
+            return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        };
+        if (start_sample) {
+            stats.wall_time_ns = wall_time();
+        }
+        timespec cpu_time{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time);
+        stats.on_cpu_ns = static_cast<unsigned long long>(cpu_time.tv_sec) * 1000000000ULL + cpu_time.tv_nsec;
+        if (!start_sample) {
+            stats.wall_time_ns = wall_time();
+        }
+    }
+
+    /// Get the change of a scheduler metric between two samples.
+    inline unsigned long long scheduler_metric_delta(int metric, const SchedulerStats &start,
+                                                     const SchedulerStats &stop) {
+        if (metric == MINI_VOLUNTARY_SWITCHES) {
+            return stop.voluntary_switches - start.voluntary_switches;
+        } else if (metric == MINI_INVOLUNTARY_SWITCHES) {
+            return stop.involuntary_switches - start.involuntary_switches;
+        } else if (metric == MINI_ON_CPU_TIME) {
+            return stop.on_cpu_ns - start.on_cpu_ns;
+        } else if (metric == MINI_RUN_QUEUE_TIME) {
+            return stop.run_queue_ns - start.run_queue_ns;
+        } else if (metric == MINI_BLOCKED_TIME) {
+            auto wall = stop.wall_time_ns - start.wall_time_ns;
+            auto busy = (stop.on_cpu_ns - start.on_cpu_ns) + (stop.run_queue_ns - start.run_queue_ns);
+            return wall > busy ? wall - busy : 0;
+        } else if (metric == MINI_MINOR_FAULTS) {
+            return stop.minor_faults - start.minor_faults;
+        } else if (metric == MINI_MAJOR_FAULTS) {
+            return stop.major_faults - start.major_faults;
+        } else if (metric == MINI_CPU_MIGRATIONS) {
+            return stop.cpu_migrations - start.cpu_migrations;
+        } else {
+            return 0;
+        }
+    }
+
+    /// Parse a sysfs id list like "0-3,8-11" into the ids.
+    inline std::vector<int> parse_id_list(std::string_view text) {
+        std::vector<int> ids;
+        size_t pos = 0;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+            auto first = static_cast<int>(parse_proc_number(text, pos));
+            auto last = first;
+            if (pos < text.size() && text[pos] == '-') {
+                pos += 1;
+                last = static_cast<int>(parse_proc_number(text, pos));
+            }
+            for (int id = first; id <= last; ++id) {
+                ids.push_back(id);
+            }
+            if (pos < text.size() && text[pos] == ',') {
+                pos += 1;
+            }
+        }
+        return ids;
+    }
+
+    /// Get the CPU model name from /proc/cpuinfo, e.g. "Intel(R) Xeon(R) Platinum 8375C CPU @ 2.90GHz".
+    inline std::string get_cpu_model() {
+        std::ifstream cpuinfo("/proc/cpuinfo", std::ios_base::in);
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.rfind("model name", 0) == 0) {
+                auto pos = line.find(':');
+                if (pos != std::string::npos && pos + 2 <= line.size()) {
+                    return line.substr(pos + 2);
+                }
+            }
+        }
+        return "Unknown";
+    }
+
+    /// Get the size in bytes of the data or unified cache at the given level, reading
+    /// /sys/devices/system/cpu/cpu0/cache. Level 0 means the last level cache. Returns 0 if unknown.
+    inline size_t get_cache_size(int level = 0) {
+        using std::ifstream;
+        using std::string;
+
+        size_t size = 0;
+        int found_level = 0;
+        for (int index = 0;; ++index) {
+            auto dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+            ifstream level_stream(dir + "level"), type_stream(dir + "type"), size_stream(dir + "size");
+            if (!level_stream || !type_stream || !size_stream) {
+                break;
+            }
+            int cache_level;
+            string type, size_str;
+            level_stream >> cache_level;
+            type_stream >> type;
+            size_stream >> size_str;
+            if (type == "Instruction" || size_str.empty()) {
+                continue;
+            }
+            // Sizes look like "48K", "2048K" or "105M".
+            size_t cache_size = std::stoull(size_str);
+            if (size_str.back() == 'K') {
+                cache_size *= 1024;
+            } else if (size_str.back() == 'M') {
+                cache_size *= 1024 * 1024;
+            }
+            if (level == 0 ? cache_level > found_level : cache_level == level) {
+                found_level = cache_level;
+                size = cache_size;
+            }
+        }
+        return size;
+    }
+
 }   // namespace mperf
\ No newline at end of file
@@ -24,6 +24,14 @@ int main() {
             arr[i] = std::sin(i);
         }
     MiniUnitEnd("Benchmark Report2", true, "bencmark_sample.csv")
+    // Same loop with the input flushed from the caches before every iteration
+    MiniCacheMode(MINI_CACHE_COLD)
+    MiniCacheBuffer(arr, sizeof(arr))
+    MiniUnitStart
+        for(size_t i = 0; i < N; i++) {
+            arr[i] = std::sin(i);
+        }
+    MiniUnitEnd("Benchmark Report3", true, "bencmark_sample.csv")
     MiniEnd
 
     return 0;
@@ -0,0 +1,134 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include "mini_coroutine.hpp"
+#include <chrono>
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <latch>
+#include <mutex>
+#include <thread>
+
+using namespace mperf;
+using Perf = MiniPerf<std::chrono::microseconds>;
+
+// A worker thread that resumes coroutines after a delay, standing in for an I/O event loop.
+class Worker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::pair<std::coroutine_handle<>, std::chrono::milliseconds>> queue;
+    bool done = false;
+    std::thread thread{[this]() { run(); }};
+
+    void run() {
+        while (true) {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [this]() { return done || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            auto [handle, delay] = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            std::this_thread::sleep_for(delay);
+            handle.resume();
+        }
+    }
+
+public:
+    void post(std::coroutine_handle<> handle, std::chrono::milliseconds delay) {
+        {
+            std::lock_guard lock(mutex);
+            queue.emplace_back(handle, delay);
+        }
+        cv.notify_one();
+    }
+
+    ~Worker() {
+        {
+            std::lock_guard lock(mutex);
+            done = true;
+        }
+        cv.notify_one();
+        thread.join();
+    }
+};
+
+struct Sleep {
+    Worker &worker;
+    std::chrono::milliseconds delay;
+
+    bool await_ready() { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) { worker.post(handle, delay); }
+
+    void await_resume() {}
+};
+
+struct Task {
+    struct promise_type : MeasuredPromise<Perf> {
+        using MeasuredPromise::MeasuredPromise;
+
+        Task get_return_object() { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+void compute(size_t n) {
+    volatile float x = 0;
+    for (size_t i = 0; i < n; i++) {
+        x = x + i;
+    }
+}
+
+// Measured by timer through the promise, the 50 ms spent in each co_await are not counted.
+Task handle_request(CoroutinePerf<Perf> &timer, Worker &worker, std::latch &done) {
+    timer.start();
+    compute(1000000);
+    co_await Sleep{worker, std::chrono::milliseconds(50)};
+    // Now running on the worker thread.
+    compute(1000000);
+    co_await Sleep{worker, std::chrono::milliseconds(50)};
+    compute(1000000);
+    timer.stop();
+    done.count_down();
+}
+
+int main() {
+    Perf perf({MINI_TIME_COUNT, MINI_ON_CPU_TIME}, {}, "Coroutine Sample");
+    CoroutinePerf<Perf> timer(perf);
+    {
+        Worker worker;
+        std::latch done(1);
+        handle_request(timer, worker, done);
+        done.wait();
+    }
+    PerfReport(perf, "Coroutine Report", false, true, "");
+
+    // Both co_awaits resumed, and the 100 ms suspended are excluded from the running time
+    using std::chrono::milliseconds;
+    if (timer.get_resumptions() != 2) {
+        std::cerr << "Resumptions are " << timer.get_resumptions() << " instead of 2" << std::endl;
+        return 1;
+    }
+    if (timer.get_suspended_time() < milliseconds(100)) {
+        std::cerr << "Suspended time is " << std::chrono::duration_cast<milliseconds>(timer.get_suspended_time()).count()
+                  << " ms, less than the 100 ms slept" << std::endl;
+        return 1;
+    }
+    if (perf.get_time_count_ns() >= milliseconds(50)) {
+        std::cerr << "Running time is " << std::chrono::duration_cast<milliseconds>(perf.get_time_count_ns()).count()
+                  << " ms, the suspended time is not excluded" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
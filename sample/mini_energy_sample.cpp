@@ -0,0 +1,82 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+using namespace mperf;
+
+int main(int argc, char **argv) {
+    // Read another powercap tree, e.g. a copy of /sys/class/powercap on a machine without RAPL.
+    if (argc > 1) {
+        set_powercap_root(argv[1]);
+    }
+    const size_t requests = 100;
+    const size_t N = 1000000;
+
+    MiniPerf<std::chrono::microseconds> perf({MINI_TIME_COUNT, MINI_ENERGY_PACKAGE, MINI_ENERGY_DRAM}, {},
+                                             "Energy Sample");
+    volatile double sink = 0;
+    for (size_t r = 0; r < requests; r++) {
+        perf.start();
+        double sum = 0;
+        for (size_t i = 0; i < N; i++) {
+            sum += std::sqrt(static_cast<double>(i));
+        }
+        sink = sum;
+        perf.stop();
+    }
+    // Energy per request
+    perf.metrics_average(requests);
+
+    PerfReport(perf, "Energy Report", false, true, "");
+    PerfReportInRow(perf, "Energy Report", true, false, "energy_sample.csv");
+
+    // A fake powercap tree: package 0 wraps around max_energy_range_uj, package 1 does not
+    auto fake_root = std::filesystem::temp_directory_path() / ("mini_energy_sample." + std::to_string(getpid()));
+    auto write_file = [&](const std::string &path, const std::string &text) {
+        std::filesystem::create_directories((fake_root / path).parent_path());
+        std::ofstream(fake_root / path) << text << "\n";
+    };
+    write_file("intel-rapl:0/name", "package-0");
+    write_file("intel-rapl:0/max_energy_range_uj", "262143328850");
+    write_file("intel-rapl:0/energy_uj", "262142828850");
+    write_file("intel-rapl:1/name", "package-1");
+    write_file("intel-rapl:1/max_energy_range_uj", "262143328850");
+    write_file("intel-rapl:1/energy_uj", "1000000");
+    auto root = get_powercap_root();
+    set_powercap_root(fake_root.string());
+    int result = 0;
+    {
+        MiniPerf<std::chrono::microseconds> fake_perf({MINI_ENERGY_PACKAGE}, {}, "Fake Energy");
+        fake_perf.start();
+        write_file("intel-rapl:0/energy_uj", "1000000");
+        write_file("intel-rapl:1/energy_uj", "3000000");
+        fake_perf.stop();
+        // 0.5 J up to the wrap, 1 uJ for the wrap to 0 and 1 J after it, and 2 J
+        auto joules = fake_perf.get_last_metrics()[0].second;
+        if (std::abs(joules - 3.500001) > 1e-9) {
+            std::cerr << "Package energy of the fake powercap tree is " << joules << " J instead of 3.500001 J"
+                      << std::endl;
+            result = 1;
+        }
+
+        // Exactly at the boundary: from max_energy_range_uj to 0 is 1 uJ
+        write_file("intel-rapl:0/energy_uj", "262143328850");
+        fake_perf.start();
+        write_file("intel-rapl:0/energy_uj", "0");
+        fake_perf.stop();
+        joules = fake_perf.get_last_metrics()[0].second;
+        if (std::abs(joules - 1e-6) > 1e-12) {
+            std::cerr << "Package energy of a wrap from max_energy_range_uj to 0 is " << joules
+                      << " J instead of 1 uJ" << std::endl;
+            result = 1;
+        }
+    }
+    set_powercap_root(root);
+    std::filesystem::remove_all(fake_root);
+
+    return result;
+}
@@ -0,0 +1,51 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include <chrono>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace mperf;
+
+int main() {
+    const size_t chunk = 4096;
+    const size_t chunks = 16;
+    std::vector<char> data(chunk * chunks, 'x');
+    int fd = open("io_sample.tmp", O_CREAT | O_WRONLY | O_TRUNC, 0644);
+
+    // The results are averaged per iteration, so they show bytes and syscalls per operation.
+    std::vector<int> mini_metrics = {MINI_TIME_COUNT, MINI_WRITE_CHARS, MINI_WRITE_SYSCALLS,
+                                     MINI_STORAGE_WRITE_BYTES, MINI_SYSCALLS};
+    MiniInit("I/O Benchmark", mini_metrics, {}, 1)
+    MiniUnitStart
+        for (size_t i = 0; i < chunks; i++) {
+            write(fd, data.data() + i * chunk, chunk);
+        }
+    MiniUnitEnd("Chunked Writes", true, "io_sample.csv")
+    MiniUnitStart
+        write(fd, data.data(), data.size());
+    MiniUnitEnd("Batched Write", true, "io_sample.csv")
+    MiniEnd
+
+    // An empty region reads 0, the reads of start() and stop() themselves are not counted
+    std::vector<int> io_metrics = {MINI_READ_CHARS, MINI_READ_SYSCALLS, MINI_WRITE_CHARS, MINI_WRITE_SYSCALLS};
+    std::vector<int> empty_metrics = io_metrics;
+    empty_metrics.insert(empty_metrics.end(), {MINI_ON_CPU_TIME, MINI_NUMA_HIT, MINI_SYSCALLS});
+    MiniPerf<std::chrono::microseconds> empty_perf(empty_metrics, {PERF_COUNT_HW_INSTRUCTIONS}, "Empty Region");
+    for (size_t i = 0; i < 1000; i++) {
+        empty_perf.start();
+        empty_perf.stop();
+        auto metrics = empty_perf.get_last_metrics();
+        for (size_t m = 0; m < io_metrics.size(); m++) {
+            if (metrics[m].second != 0) {
+                std::cerr << metrics[m].first << " of an empty region is " << metrics[m].second << std::endl;
+                return 1;
+            }
+        }
+    }
+    empty_perf.report("Empty Region");
+
+    close(fd);
+    unlink("io_sample.tmp");
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include "utilities.hpp"
+#include <chrono>
+#include <vector>
+#include <linux/perf_event.h>
+
+using namespace mperf;
+
+int main() {
+    const size_t N = 1000000;
+
+    std::vector<int> mini_metrics = {MINI_TIME_COUNT, MINI_MEMORY_COUNT, MINI_CPU_UTILIZATION};
+    std::vector<int> perf_metrics = {PERF_COUNT_HW_INSTRUCTIONS};
+    // Every unit runs 5 times, each time in a fresh child process.
+    MiniInitIsolated("Isolated Benchmark", mini_metrics, perf_metrics, 1, 5)
+    MiniUnitStart
+        std::vector<float> arr(N);
+        for(size_t i = 0; i < N; i++) {
+            arr[i] = i;
+        }
+    MiniUnitEnd("Isolated Report1", true, "isolated_benchmark_sample.csv")
+    MiniUnitStart
+        std::vector<float> arr(N * 4);
+        for(size_t i = 0; i < N * 4; i++) {
+            arr[i] = i;
+        }
+    MiniUnitEnd("Isolated Report2", true, "isolated_benchmark_sample.csv")
+    MiniEnd
+
+    return 0;
+}
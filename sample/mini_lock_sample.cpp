@@ -0,0 +1,103 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include "mini_lock.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mperf;
+
+int main() {
+    const size_t N = 100000;
+    const size_t threads = 4;
+    InstrumentedMutex<> queue_mutex("Queue Mutex");
+    InstrumentedSpinLock counter_lock("Counter Lock");
+    size_t queue_size = 0, counter = 0;
+
+    MiniPerf<std::chrono::microseconds> perf({MINI_TIME_COUNT}, {}, "Lock Sample");
+    perf.track_lock(queue_mutex);
+    perf.track_lock(counter_lock);
+
+    perf.start();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (size_t i = 0; i < N; i++) {
+                {
+                    // LockGuard keeps this line as the call site, std::lock_guard would not.
+                    LockGuard guard(queue_mutex);
+                    queue_size += 1;
+                }
+                LockGuard guard(counter_lock);
+                counter += 1;
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    perf.stop();
+
+    PerfReport(perf, "Lock Report", false, true, "");
+    PerfReportInRow(perf, "Lock Report", true, false, "lock_sample.csv");
+
+    // Every acquisition is counted once, and the call sites add up to the totals
+    int result = 0;
+    auto check_sites = [&](const std::string &lock_name, const LockProfile &profile, size_t acquisitions) {
+        auto totals = profile.totals();
+        LockStats site_sum;
+        for (auto &site: profile.sites()) {
+            site_sum.contended += site.stats.contended;
+            site_sum.uncontended += site.stats.uncontended;
+            site_sum.hold_ns += site.stats.hold_ns;
+        }
+        if (totals.contended + totals.uncontended != acquisitions ||
+            site_sum.contended != totals.contended || site_sum.uncontended != totals.uncontended ||
+            site_sum.hold_ns != totals.hold_ns) {
+            std::cerr << lock_name << " counted " << totals.contended + totals.uncontended << " acquisitions and "
+                      << totals.hold_ns << "ns hold instead of " << acquisitions << ", its sites "
+                      << site_sum.contended + site_sum.uncontended << " and " << site_sum.hold_ns << "ns"
+                      << std::endl;
+            result = 1;
+        }
+    };
+    check_sites("Queue Mutex", queue_mutex.get_profile(), threads * N);
+    check_sites("Counter Lock", counter_lock.get_profile(), threads * N);
+
+    // Call sites beyond the first 3 of a thread are counted as "Other"
+    InstrumentedMutex<> site_mutex("Site Mutex");
+    for (int i = 0; i < 2; i++) {
+        { LockGuard guard(site_mutex); }
+        { LockGuard guard(site_mutex); }
+        { LockGuard guard(site_mutex); }
+        { LockGuard guard(site_mutex); }
+        { LockGuard guard(site_mutex); }
+    }
+    auto sites = site_mutex.get_profile().sites();
+    size_t other = 0;
+    for (auto &site: sites) {
+        auto count = site.stats.contended + site.stats.uncontended;
+        other += site.site == "Other" ? count : 0;
+        if (site.site != "Other" && count != 2) {
+            std::cerr << "Site " << site.site << " counted " << count << " acquisitions instead of 2" << std::endl;
+            result = 1;
+        }
+    }
+    if (sites.size() != 4 || other != 4) {
+        std::cerr << "Site Mutex has " << sites.size() << " sites and " << other
+                  << " other acquisitions instead of 4 and 4" << std::endl;
+        result = 1;
+    }
+
+    // A spinlock released by another thread adds its hold time to the site of the acquiring thread
+    InstrumentedSpinLock handover_lock("Handover Lock");
+    handover_lock.lock();
+    std::thread([&]() {
+        handover_lock.unlock();
+    }).join();
+    check_sites("Handover Lock", handover_lock.get_profile(), 1);
+
+    return result;
+}
@@ -0,0 +1,32 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+using namespace mperf;
+
+int main() {
+    const size_t bytes = 256 << 20;
+
+    // Placement of the whole process
+    MiniPerf<std::chrono::microseconds> process_perf({MINI_TIME_COUNT, MINI_NUMA_PAGES, MINI_ANON_HUGE_PAGES,
+                                                      MINI_NUMA_HIT, MINI_NUMA_MISS, MINI_CURRENT_CPU,
+                                                      MINI_CURRENT_NODE}, {}, "NUMA Process");
+    // Placement of one buffer, pages land on the node of the thread that first touches them
+    MiniPerf<std::chrono::microseconds> buffer_perf({MINI_TIME_COUNT, MINI_NUMA_PAGES}, {}, "NUMA Buffer");
+    auto *buffer = static_cast<char *>(std::aligned_alloc(2 << 20, bytes));
+    buffer_perf.track_numa_buffer(buffer, bytes);
+
+    process_perf.start();
+    buffer_perf.start();
+    std::memset(buffer, 1, bytes);
+    buffer_perf.stop();
+    process_perf.stop();
+
+    PerfReport(process_perf, "NUMA Report", false, true, "");
+    PerfReport(buffer_perf, "NUMA Report", false, true, "");
+
+    std::free(buffer);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "mini_perf.hpp"
+#include "mini_openmetrics.hpp"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace mperf;
+
+// GET /metrics from the endpoint on localhost, returns the whole response or "" on failure.
+std::string scrape(unsigned short port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return "";
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    std::string response;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+        std::string request = "GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+            char buffer[4096];
+            ssize_t bytes;
+            // The server closes the connection after the response
+            while ((bytes = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                response.append(buffer, bytes);
+            }
+        }
+    }
+    close(fd);
+    return response;
+}
+
+int main(int argc, char **argv) {
+    const size_t requests = 1000;
+    const size_t threads = 4;
+    OpenMetricsExporter exporter("mini_perf", {1e-6, 1e-5, 1e-4, 1e-3, 1e-2}, std::chrono::milliseconds(100));
+    auto port = exporter.start_server(argc > 1 ? std::stoi(argv[1]) : 0);
+    std::cout << "Serving http://127.0.0.1:" << port << "/metrics" << std::endl;
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&exporter, t]() {
+            MiniPerf<std::chrono::microseconds> perf({MINI_TIME_COUNT, MINI_VOLUNTARY_SWITCHES},
+                                                     {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS},
+                                                     t % 2 == 0 ? "Parse \"Request\"" : "Handle Request");
+            volatile double sink = 0;
+            for (size_t r = 0; r < requests; r++) {
+                perf.start();
+                double sum = 0;
+                for (size_t i = 0; i < 1000 * (t + 1); i++) {
+                    sum += std::sqrt(static_cast<double>(i));
+                }
+                sink = sum;
+                perf.stop();
+                exporter.observe(perf);
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+
+    exporter.publish();
+    // For the node_exporter textfile collector
+    exporter.write_textfile("mini_perf.prom");
+    std::cout << *exporter.get_snapshot();
+
+    // A scrape returns the same exposition as the textfile, with the OpenMetrics content type
+    auto response = scrape(port);
+    auto header_end = response.find("\r\n\r\n");
+    auto headers = response.substr(0, header_end);
+    auto body = header_end == std::string::npos ? "" : response.substr(header_end + 4);
+    std::stringstream textfile;
+    textfile << std::ifstream("mini_perf.prom").rdbuf();
+    if (headers.rfind("HTTP/1.1 200 OK\r\n", 0) != 0 ||
+        headers.find("Content-Type: " + std::string(OpenMetricsExporter::content_type)) == std::string::npos ||
+        headers.find("Content-Length: " + std::to_string(body.size())) == std::string::npos) {
+        std::cerr << "Unexpected response headers:\n" << headers << std::endl;
+        return 1;
+    }
+    if (body != textfile.str()) {
+        std::cerr << "The scraped body differs from mini_perf.prom" << std::endl;
+        return 1;
+    }
+    // Every observation is counted once
+    std::istringstream lines(body);
+    std::string line;
+    size_t observations = 0;
+    while (std::getline(lines, line)) {
+        if (line.rfind("mini_perf_region_observations_total{", 0) == 0) {
+            observations += std::stoull(line.substr(line.rfind(' ') + 1));
+        }
+    }
+    if (observations != threads * requests) {
+        std::cerr << "Scraped " << observations << " observations instead of " << threads * requests << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
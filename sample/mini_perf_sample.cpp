@@ -1,6 +1,7 @@
 ﻿#include "mini_perf.hpp"
 #include "utilities.hpp"
 #include <chrono>
+#include <thread>
 #include <linux/perf_event.h>
 
 using namespace mperf;
@@ -29,5 +30,29 @@ int main() {
     mp2.stop();
     mp2.report("MiniPerf2 Report", false, true, "");
 
+    // A sleeping region is mostly blocked, a busy region mostly on a CPU
+    MiniPerf<std::chrono::microseconds> sched_perf({MINI_ON_CPU_TIME, MINI_RUN_QUEUE_TIME, MINI_BLOCKED_TIME}, {}, "Scheduler");
+    for (bool busy: {false, true}) {
+        sched_perf.start();
+        if (busy) {
+            auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+            while (std::chrono::steady_clock::now() < end) {}
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        sched_perf.stop();
+        auto metrics = sched_perf.get_last_metrics();
+        size_t expected = busy ? 0 : 2;
+        for (size_t m = 0; m < metrics.size(); m++) {
+            if (m != expected && metrics[m].second >= metrics[expected].second) {
+                std::cerr << metrics[m].first << " of a " << (busy ? "busy" : "sleeping") << " region is "
+                          << metrics[m].second << ", " << metrics[expected].first << " is only "
+                          << metrics[expected].second << std::endl;
+                return 1;
+            }
+        }
+    }
+    sched_perf.report("Scheduler");
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "mini_perf.hpp"
+#include "mini_perf_macro.hpp"
+#include "mini_roofline.hpp"
+#include <chrono>
+#include <vector>
+
+using namespace mperf;
+
+int main() {
+    const size_t N = 1000000;
+    const size_t repeats = 100;
+    std::vector<double> x(N, 1.0), y(N, 2.0);
+
+    // Probes the machine on the first run, later runs read the cached profile.
+    auto profile = load_machine_profile("./mini_perf_machine.profile");
+
+    MiniPerf<std::chrono::microseconds> perf({MINI_TIME_COUNT}, {}, "Roofline DAXPY");
+    // Each repeat is measured on its own, otherwise the compiler may fuse repeats (unroll and jam)
+    // and move less data than declared below.
+    for (size_t r = 0; r < repeats; r++) {
+        perf.start();
+        for (size_t i = 0; i < N; i++) {
+            y[i] = 0.5 * x[i] + y[i];
+        }
+        perf.stop();
+    }
+    perf.metrics_average(repeats);
+
+    // 2 FLOPs and 3 doubles moved (load x, load y, store y) per element, the 16 MB working set lives in the LLC.
+    // Without -march flags the loop is compiled to SSE2.
+    add_roofline_metrics(perf, profile, 2.0 * N, 3.0 * sizeof(double) * N, MINI_ROOF_LLC, MINI_ROOF_SSE);
+    PerfReport(perf, "DAXPY Report", false, true, "");
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include "mini_perf.hpp"
+#include "mini_sketch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace mperf;
+
+void work(size_t n) {
+    volatile float x = 0;
+    for (size_t i = 0; i < n; i++) {
+        x = x + i;
+    }
+}
+
+// Process p has a slow request every (p + 2) requests, the others vary in size.
+size_t request_size(int p, size_t r) {
+    return r % (p + 2) == 0 ? 100000 : 10000 + 100 * (r % 50);
+}
+
+int main() {
+    const int processes = 4;
+    const size_t requests = 1000;
+
+    // Each process stands in for a host: it measures its requests and saves its own summary.
+    std::vector<pid_t> children;
+    for (int p = 0; p < processes; p++) {
+        auto file_path = "sketch_sample_" + std::to_string(p) + ".summary";
+        std::remove(file_path.c_str());
+        pid_t pid = fork();
+        if (pid == 0) {
+            MiniPerf<std::chrono::microseconds> perf({MINI_TIME_COUNT}, {}, "Request");
+            PerfSummary summary;
+            for (size_t r = 0; r < requests; r++) {
+                auto n = request_size(p, r);
+                perf.start();
+                work(n);
+                perf.stop();
+                summary.record(perf);
+                summary.add("Request", "Work Size", n);
+            }
+            summary.save(file_path);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (int p = 0; p < processes; p++) {
+        int status;
+        if (waitpid(children[p], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << "Process " << p << " did not save its summary." << std::endl;
+            return 1;
+        }
+    }
+
+    // Same as: mini_perf_merge sketch_sample_0.summary sketch_sample_1.summary ...
+    PerfSummary merged;
+    for (int p = 0; p < processes; p++) {
+        merged.merge(PerfSummary::load("sketch_sample_" + std::to_string(p) + ".summary"));
+    }
+    merged.report();
+
+    // The work sizes are known, so the merged quantiles can be checked against the exact ones
+    std::vector<double> sizes;
+    for (int p = 0; p < processes; p++) {
+        for (size_t r = 0; r < requests; r++) {
+            sizes.push_back(request_size(p, r));
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+    auto &summary = merged.get_regions().at("Request").at("Work Size");
+    for (auto q: {0.5, 0.99}) {
+        auto exact = sizes[static_cast<size_t>(q * (sizes.size() - 1))];
+        auto estimate = summary.quantile(q);
+        if (std::abs(estimate - exact) > 0.01 * exact) {
+            std::cerr << "Merged P" << q * 100 << " of the work size is " << estimate << " instead of " << exact
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    // A file cut between two records, as a crashed process may leave it, is rejected
+    {
+        std::ifstream full("sketch_sample_0.summary");
+        std::ofstream truncated("sketch_sample_truncated.summary", std::ios::trunc);
+        std::string line;
+        // Header, region and the first complete metric record
+        for (int i = 0; i < 5 && std::getline(full, line); i++) {
+            truncated << line << "\n";
+        }
+    }
+    bool rejected = false;
+    try {
+        PerfSummary::load("sketch_sample_truncated.summary");
+    } catch (const std::runtime_error &) {
+        rejected = true;
+    }
+    std::remove("sketch_sample_truncated.summary");
+    if (!rejected) {
+        std::cerr << "A summary file truncated at a record boundary was loaded." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include "mini_system.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+using namespace mperf;
+
+int main() {
+    const size_t N = 10000000;
+
+    try {
+        // All processes on every online CPU, kernel included.
+        SystemPerf<std::chrono::microseconds> perf({PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_CACHE_MISSES}, "System Sample");
+        volatile double sink = 0;
+        perf.start();
+        double sum = 0;
+        for (size_t i = 0; i < N; i++) {
+            sum += std::sqrt(static_cast<double>(i));
+        }
+        sink = sum;
+        perf.stop();
+
+        perf.report("System Report");
+        perf.report_in_row("System Report", true, false, "system_sample.csv");
+    } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
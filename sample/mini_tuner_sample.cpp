@@ -0,0 +1,40 @@
+#include "mini_perf.hpp"
+#include "mini_tuner.hpp"
+#include <chrono>
+#include <vector>
+
+using namespace mperf;
+
+int main() {
+    const size_t N = 1024;
+    std::vector<double> in(N * N, 1.0), out(N * N);
+
+    // Blocked matrix transpose, tuned over the block size and the loop order.
+    AutoTuner tuner("Transpose", {TuneParameter::powers_of_two("block", 4, 256),
+                                  TuneParameter::enumeration("order", {"Row", "Column"})});
+    tuner.set_strategy(MINI_TUNE_SUCCESSIVE_HALVING);
+    tuner.set_samples(4);
+    tuner.set_cache("./tuner_sample.cache");
+
+    auto result = tuner.tune([&](const TuneConfig &config) {
+        auto block = static_cast<size_t>(config.at("block"));
+        bool row_order = config.at("order") == 0;
+        for (size_t bi = 0; bi < N; bi += block) {
+            for (size_t bj = 0; bj < N; bj += block) {
+                for (size_t i = bi; i < bi + block; i++) {
+                    for (size_t j = bj; j < bj + block; j++) {
+                        if (row_order) {
+                            out[j * N + i] = in[i * N + j];
+                        } else {
+                            out[i * N + j] = in[j * N + i];
+                        }
+                    }
+                }
+            }
+        }
+    });
+    // The second run on this machine loads the result from the cache.
+    tuner.report(result);
+
+    return 0;
+}
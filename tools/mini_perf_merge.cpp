@@ -0,0 +1,46 @@
+#include "mini_perf.hpp"
+#include "mini_sketch.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace mperf;
+
+// Usage: mini_perf_merge [-o merged_summary] [-c report.csv] summary_file...
+// Merges summary files written by PerfSummary::save(), e.g. one per host or process, and reports
+// the fleet-wide quantiles of every region. Invalid or truncated files are rejected with a message
+// and the exit status is 1, the other files are still merged.
+int main(int argc, char **argv) {
+    std::string output_path, csv_path;
+    std::vector<std::string> input_paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "-o" || arg == "-c") && i + 1 < argc) {
+            (arg == "-o" ? output_path : csv_path) = argv[++i];
+        } else {
+            input_paths.push_back(arg);
+        }
+    }
+    if (input_paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-o merged_summary] [-c report.csv] summary_file..." << std::endl;
+        return 1;
+    }
+
+    PerfSummary merged;
+    int status = 0;
+    for (auto &path: input_paths) {
+        try {
+            merged.merge(PerfSummary::load(path));
+        } catch (const std::exception &e) {
+            std::cerr << "Rejected " << path << ": " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    if (!output_path.empty()) {
+        merged.save(output_path);
+    }
+    merged.report(!csv_path.empty(), true, csv_path);
+
+    return status;
+}
@@ -0,0 +1,227 @@
+#include "mini_perf.hpp"
+#include "utilities.hpp"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+
+using namespace mperf;
+
+// Usage: mini_perf_overhead_bench [output_csv]
+// Measures the per-call cost of Mini Perf's own hot paths and writes one row per case:
+//   Case,Variant,Calls,Latency(ns),Instructions
+// Latency and instructions are per call (a start()/stop() pair, a counter read or a report).
+// Instructions include the kernel if perf_event_paranoid allows it, the column is named
+// "User Instructions" otherwise, and they are 0 if the hardware counters are not available.
+// The variant is marked "(unavailable)" if the counters, RAPL files or syscall tracepoint under
+// test failed to open, the latency is not meaningful then, and "(multiplexed)" if the kernel
+// multiplexed them or the instruction counter.
+
+const size_t calls = 10000;
+
+struct Measurement {
+    double latency_ns;
+    double instructions;
+    bool multiplexed;
+};
+
+LinuxEvents<> *instruction_counter = nullptr;
+
+template<typename Body>
+Measurement measure(size_t count, Body body) {
+    std::vector<unsigned long long> instructions(1);
+    // Warm up
+    for (size_t i = 0; i < count / 10 + 1; i++) {
+        body();
+    }
+    if (instruction_counter->is_working()) {
+        instruction_counter->start();
+    }
+    auto begin = ClockType::now();
+    for (size_t i = 0; i < count; i++) {
+        body();
+    }
+    std::chrono::duration<double, std::nano> elapsed = ClockType::now() - begin;
+    if (instruction_counter->is_working()) {
+        instruction_counter->end(instructions);
+    }
+    return {elapsed.count() / count, static_cast<double>(instructions[0]) / count,
+            instruction_counter->is_working() && instruction_counter->is_multiplexed()};
+}
+
+std::string label(const std::string &variant, bool working, bool multiplexed) {
+    if (!working) {
+        return variant + " (unavailable)";
+    }
+    return multiplexed ? variant + " (multiplexed)" : variant;
+}
+
+// start()/stop() of perf, labelled by the state of its counters and readers.
+std::pair<std::string, Measurement> measure_perf(MiniPerf<std::chrono::nanoseconds> &perf,
+                                                 const std::string &variant) {
+    bool multiplexed = false;
+    auto m = measure(calls, [&]() {
+        perf.start();
+        perf.stop();
+        multiplexed |= perf.counters_multiplexed();
+    });
+    return {label(variant, perf.counters_working() && perf.readers_working(), multiplexed || m.multiplexed), m};
+}
+
+// Perf metrics needed by the derived mini metrics.
+std::vector<int> required_perf_metrics(int flag) {
+    if (flag == MINI_CACHE_MISS_RATE) {
+        return {PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+    } else if (flag == MINI_BRANCH_MISS_RATE) {
+        return {PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+    } else if (flag == MINI_AVERAGE_IPC) {
+        return {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS};
+    }
+    return {};
+}
+
+void write_row(std::ofstream &file, const std::string &name, const std::string &variant, size_t count,
+               const Measurement &m) {
+    auto msg = name + "," + variant + "," + std::to_string(count) + "," + std::to_string(m.latency_ns) + "," +
+               std::to_string(m.instructions);
+    log_println(msg, true, true, file);
+}
+
+// Userspace counter read through the perf mmap page with rdpmc, as documented in perf_event_open(2).
+// Returns false if the kernel does not allow rdpmc for this event.
+bool measure_rdpmc(Measurement &result) {
+#if defined(__x86_64__) || defined(__i386__)
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd == -1) {
+        return false;
+    }
+    auto page_size = sysconf(_SC_PAGE_SIZE);
+    void *addr = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    auto *page = static_cast<volatile perf_event_mmap_page *>(addr);
+    bool supported = page->cap_user_rdpmc && page->index != 0;
+    if (supported) {
+        volatile long long sink = 0;
+        result = measure(calls, [&]() {
+            unsigned int seq;
+            long long count;
+            do {
+                seq = page->lock;
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                count = page->offset;
+                if (page->index) {
+                    unsigned int low, high;
+                    asm volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(page->index - 1));
+                    // Only the low pmc_width bits are valid, sign extend them
+                    auto width = page->pmc_width;
+                    auto pmc = static_cast<long long>(static_cast<unsigned long long>(high) << 32 | low);
+                    count += static_cast<long long>(static_cast<unsigned long long>(pmc) << (64 - width)) >>
+                             (64 - width);
+                }
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            } while (page->lock != seq);
+            sink = count;
+        });
+    }
+    munmap(addr, page_size);
+    close(fd);
+    return supported;
+#else
+    return false;
+#endif
+}
+
+int main(int argc, char **argv) {
+    std::string output_path = argc > 1 ? argv[1] : "mini_perf_overhead.csv";
+    std::ofstream file(output_path, std::ios::trunc);
+
+    // Count the instructions in the kernel too, the syscalls are most of the cost
+    auto counter = std::make_unique<LinuxEvents<>>(std::vector<int>{PERF_COUNT_HW_INSTRUCTIONS}, false);
+    bool with_kernel = counter->is_working();
+    if (!with_kernel) {
+        std::cerr << "Counting user space instructions only" << std::endl;
+        counter = std::make_unique<LinuxEvents<>>(std::vector<int>{PERF_COUNT_HW_INSTRUCTIONS});
+    }
+    instruction_counter = counter.get();
+    log_println(std::string("Case,Variant,Calls,Latency(ns),") + (with_kernel ? "Instructions" : "User Instructions"),
+                true, true, file);
+
+    // start()/stop() with each mini metric on its own
+    for (int flag = 0; flag <= static_cast<int>(MINI_ATTRIBUTE_MAX); flag++) {
+        MiniPerf<std::chrono::nanoseconds> perf({flag}, required_perf_metrics(flag), "Overhead");
+        auto [variant, m] = measure_perf(perf, get_mini_metric_name(flag));
+        write_row(file, "mini_flag", variant, calls, m);
+    }
+
+    // start()/stop() with growing perf counter groups
+    std::vector<int> all_events = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                   PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+                                   PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+                                   PERF_COUNT_HW_BUS_CYCLES, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND,
+                                   PERF_COUNT_HW_STALLED_CYCLES_BACKEND, PERF_COUNT_HW_REF_CPU_CYCLES};
+    for (size_t size = 1; size <= all_events.size(); size++) {
+        std::vector<int> events(all_events.begin(), all_events.begin() + size);
+        MiniPerf<std::chrono::nanoseconds> perf({}, events, "Overhead");
+        auto [variant, m] = measure_perf(perf, std::to_string(size) + " events");
+        write_row(file, "perf_group", variant, calls, m);
+    }
+
+    // Counter read paths: read() syscall of running counters, userspace rdpmc
+    {
+        LinuxEvents<> events({PERF_COUNT_HW_INSTRUCTIONS});
+        std::vector<unsigned long long> results(1);
+        events.start();
+        auto m = measure(calls, [&]() {
+            events.read_counters(results);
+        });
+        write_row(file, "counter_read", label("syscall", events.is_working(), m.multiplexed), calls, m);
+        Measurement rdpmc{};
+        bool supported = measure_rdpmc(rdpmc);
+        write_row(file, "counter_read", label("rdpmc", supported, rdpmc.multiplexed), calls, rdpmc);
+    }
+
+    // report()/report_in_row() throughput, each written to its own temporary file. report()
+    // prints the log file path to stdout, which is silenced while measuring. The CSV file gets
+    // its header before measuring, so every timed report_in_row() appends under an unchanged one.
+    {
+        MiniPerf<std::chrono::nanoseconds> perf({MINI_TIME_COUNT, MINI_MEMORY_COUNT}, {PERF_COUNT_HW_INSTRUCTIONS},
+                                                "Overhead");
+        perf.start();
+        perf.stop();
+        perf.add_custom_metric("Iterations", "1");
+        auto report_path = (std::filesystem::temp_directory_path() / "mini_perf_overhead_report.log").string();
+        auto row_path = (std::filesystem::temp_directory_path() / "mini_perf_overhead_report.csv").string();
+        std::filesystem::remove(report_path);
+        std::filesystem::remove(row_path);
+        const size_t reports = 1000;
+        std::ofstream null_stream;
+        auto *stdout_buffer = std::cout.rdbuf(null_stream.rdbuf());
+        perf.report_in_row("Overhead Report", true, false, row_path);
+        auto report = measure(reports, [&]() {
+            perf.report("Overhead Report", true, false, report_path);
+        });
+        auto report_in_row = measure(reports, [&]() {
+            perf.report_in_row("Overhead Report", true, false, row_path);
+        });
+        std::cout.rdbuf(stdout_buffer);
+        std::filesystem::remove(report_path);
+        std::filesystem::remove(row_path);
+        write_row(file, "report", label("report", true, report.multiplexed), reports, report);
+        write_row(file, "report", label("report_in_row", true, report_in_row.multiplexed), reports, report_in_row);
+    }
+
+    return 0;
+}
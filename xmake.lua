@@ -31,6 +31,113 @@ target("mini_benchmark_sample")
     add_files("sample/mini_benchmark_sample.cpp")  
     add_includedirs("include") 
     add_headerfiles("include/*")
+
+target("mini_roofline_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_roofline_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_isolated_benchmark_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_isolated_benchmark_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_lock_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_lock_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+    add_syslinks("pthread")
+
+target("mini_coroutine_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_coroutine_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+    add_syslinks("pthread")
+
+target("mini_sketch_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_sketch_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_energy_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_energy_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_openmetrics_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_openmetrics_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+    add_syslinks("pthread")
+
+target("mini_numa_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_numa_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_io_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_io_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_tuner_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_tuner_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_system_sample")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("sample/mini_system_sample.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_perf_merge")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("tools/mini_perf_merge.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
+
+target("mini_perf_overhead_bench")
+    set_languages("c++20")
+    set_optimize("fastest")
+    set_kind("binary")
+    add_files("tools/mini_perf_overhead_bench.cpp")
+    add_includedirs("include")
+    add_headerfiles("include/*")
     
 -- If you want to known more usage about xmake, please see https://xmake.io
 --